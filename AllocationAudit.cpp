@@ -0,0 +1,126 @@
+/**
+ * @file AllocationAudit.cpp
+ * @author zah
+ * @brief Implementation of the allocation audit and its counting global allocator
+ * @version 0.1
+ * @date 2024-02-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "AllocationAudit.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+
+namespace {
+    std::atomic<bool> s_armed{ false };
+    std::atomic<uint64_t> s_violations{ 0 };
+    thread_local int t_scopeDepth = 0;
+} // namespace
+
+bool AllocationAudit::isAvailable() {
+#ifdef ALLOCATION_AUDIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationAudit::arm(bool armed) {
+    s_armed.store(armed);
+}
+
+void AllocationAudit::reset() {
+    s_violations.store(0);
+}
+
+uint64_t AllocationAudit::getViolations() {
+    return s_violations.load();
+}
+
+AllocationAudit::Scope::Scope() {
+    ++t_scopeDepth;
+}
+
+AllocationAudit::Scope::~Scope() {
+    --t_scopeDepth;
+}
+
+#ifdef ALLOCATION_AUDIT
+namespace {
+    void count_allocation() {
+        if (t_scopeDepth > 0 && s_armed.load(std::memory_order_relaxed)) {
+            s_violations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void* counted_alloc(std::size_t size) {
+        count_allocation();
+        void* p = std::malloc(size ? size : 1);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void* counted_aligned_alloc(std::size_t size, std::align_val_t alignment) {
+        count_allocation();
+        const std::size_t align = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+        void* p = _aligned_malloc(size ? size : 1, align);
+#else
+        void* p = std::aligned_alloc(align, (size + align - 1) / align * align + (size ? 0 : align)); // Size must be a non-zero multiple of the alignment
+#endif
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void aligned_free(void* p) {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+} // namespace
+
+// Every replaceable form counts, so containers with over-aligned types or nothrow callers can't slip past the audit
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new(std::size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    try { return counted_aligned_alloc(size, alignment); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    try { return counted_aligned_alloc(size, alignment); } catch (const std::bad_alloc&) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+#endif
@@ -0,0 +1,42 @@
+/**
+* @file AllocationAudit.h
+* @author zah
+* @brief Header for the allocation audit: counts heap allocations made on real-time paths
+* @version 0.1
+* @date 2024-02-16
+*
+* @copyright Copyright (c) 2024
+*
+* Build with ALLOCATION_AUDIT defined to replace the global operator new with a counting one.
+* Code on the capture, send and receive paths opens an ALLOCATION_AUDIT_SCOPE; while the audit is
+* armed, every allocation made by a thread inside such a scope is a violation. Without the define
+* the scopes compile to nothing and nothing is counted.
+*/
+#ifndef ALLOCATIONAUDIT_H
+#define ALLOCATIONAUDIT_H
+
+#include <cstdint>
+
+namespace AllocationAudit {
+    bool isAvailable(); ///< True if built with ALLOCATION_AUDIT (the counting allocator is installed)
+    void arm(bool armed); ///< Starts or stops counting (disarmed during warm-up)
+    void reset(); ///< Clears the violation count
+    uint64_t getViolations(); ///< Allocations made inside a scope while armed
+
+    /// @brief Marks the current thread as being on a real-time path for its lifetime
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+} // namespace AllocationAudit
+
+#ifdef ALLOCATION_AUDIT
+#define ALLOCATION_AUDIT_SCOPE() AllocationAudit::Scope allocationAuditScope
+#else
+#define ALLOCATION_AUDIT_SCOPE() ((void)0)
+#endif
+
+#endif // ALLOCATIONAUDIT_H
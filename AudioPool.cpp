@@ -0,0 +1,42 @@
+/**
+ * @file AudioPool.cpp
+ * @author zah
+ * @brief Implementation of AudioBufferPool class
+ * @version 0.1
+ * @date 2024-02-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "AudioPool.h"
+
+
+void AudioBufferPool::reset(std::size_t buffers, std::size_t bufferBytes) {
+    m_buffers.clear();
+    m_buffers.resize(buffers);
+    m_free.clear();
+    m_free.reserve(buffers);
+    for (AudioBuffer& buffer : m_buffers) {
+        buffer.bytes.resize(bufferBytes);
+        buffer.size = 0;
+        m_free.push_back(&buffer);
+    }
+}
+
+AudioBuffer* AudioBufferPool::acquire() {
+    if (m_free.empty()) {
+        return nullptr;
+    }
+    AudioBuffer* buffer = m_free.back();
+    m_free.pop_back();
+    return buffer;
+}
+
+void AudioBufferPool::release(AudioBuffer* buffer) {
+    buffer->size = 0;
+    m_free.push_back(buffer);
+}
+
+std::size_t AudioBufferPool::available() const {
+    return m_free.size();
+}
@@ -0,0 +1,73 @@
+/**
+* @file AudioPool.h
+* @author zah
+* @brief Header for AudioBufferPool and FixedRing: preallocated storage for audio on its way to the socket
+* @version 0.1
+* @date 2024-02-16
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef AUDIOPOOL_H
+#define AUDIOPOOL_H
+
+#include <cstddef>
+#include <vector>
+
+/// @brief PCM bytes of one chunk, capacity fixed when the pool is sized
+struct AudioBuffer {
+    std::vector<char> bytes; ///< Storage, never resized after AudioBufferPool::reset
+    std::size_t size{ 0 }; ///< Bytes in use
+
+    const char* data() const { return bytes.data(); }
+    std::size_t capacity() const { return bytes.size(); }
+};
+
+/// @brief Fixed set of equally sized audio buffers handed out and returned without allocating
+///
+/// Not thread-safe: RealTimeTranscriber only touches it under its audio queue mutex.
+class AudioBufferPool {
+public:
+    void reset(std::size_t buffers, std::size_t bufferBytes); ///< Allocates every buffer up front (not on a real-time thread)
+
+    AudioBuffer* acquire(); ///< Returns a free buffer, or nullptr if all are in use
+    void release(AudioBuffer* buffer); ///< Returns a buffer to the pool
+
+    std::size_t available() const; ///< Returns the number of free buffers
+
+private:
+    std::vector<AudioBuffer> m_buffers; ///< Every buffer of the pool
+    std::vector<AudioBuffer*> m_free; ///< Free list, capacity reserved for all buffers
+};
+
+/// @brief Bounded FIFO over preallocated storage, push and pop never allocate
+template <typename T>
+class FixedRing {
+public:
+    void reset(std::size_t capacity) { m_items.assign(capacity, T{}); m_head = 0; m_size = 0; } ///< Sets the capacity and empties the ring
+
+    bool push_back(const T& item) {
+        if (m_size == m_items.size()) {
+            return false;
+        }
+        m_items[(m_head + m_size) % m_items.size()] = item;
+        ++m_size;
+        return true;
+    } ///< Appends an item, false if the ring is full
+
+    T& front() { return m_items[m_head]; } ///< Oldest item (ring must not be empty)
+    void pop_front() { m_head = (m_head + 1) % m_items.size(); --m_size; } ///< Drops the oldest item (ring must not be empty)
+    const T& at(std::size_t index) const { return m_items[(m_head + index) % m_items.size()]; } ///< Item at an index, 0 is the oldest (index < size())
+
+    bool empty() const { return m_size == 0; }
+    bool full() const { return m_size == m_items.size(); }
+    std::size_t size() const { return m_size; }
+    std::size_t capacity() const { return m_items.size(); }
+
+private:
+    std::vector<T> m_items; ///< Storage
+    std::size_t m_head{ 0 }; ///< Index of the oldest item
+    std::size_t m_size{ 0 }; ///< Items held
+};
+
+#endif // AUDIOPOOL_H
@@ -0,0 +1,340 @@
+/**
+ * @file AudioRuntime.cpp
+ * @author zah
+ * @brief Implementation of AudioRuntime and InputStreamLease classes
+ * @version 0.1
+ * @date 2024-03-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "AudioRuntime.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <iostream>
+
+
+namespace {
+    std::mutex s_runtimeMutex; ///< Guards s_runtime
+    std::weak_ptr<AudioRuntime> s_runtime; ///< Current runtime, if anyone holds it
+    std::mutex s_paMutex; ///< Serializes Pa_Initialize and Pa_Terminate, a dying runtime may overlap its successor
+
+    std::string lower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+} // namespace
+
+bool InputStreamConfig::operator==(const InputStreamConfig& other) const {
+    return device == other.device
+        && channels == other.channels
+        && format == other.format
+        && sampleRate == other.sampleRate
+        && framesPerBuffer == other.framesPerBuffer
+        && blocking == other.blocking;
+}
+
+std::shared_ptr<AudioRuntime> AudioRuntime::acquire() {
+    std::lock_guard<std::mutex> lock(s_runtimeMutex);
+    std::shared_ptr<AudioRuntime> runtime = s_runtime.lock();
+    if (!runtime) {
+        runtime.reset(new AudioRuntime());
+        s_runtime = runtime;
+    }
+    return runtime;
+}
+
+AudioRuntime::AudioRuntime() {
+    {
+        std::lock_guard<std::mutex> lock(s_paMutex);
+        m_initError = Pa_Initialize();
+    }
+    if (m_initError != paNoError) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_initError) << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    enumerate();
+}
+
+AudioRuntime::~AudioRuntime() {
+    // Leases hold a reference, so every stream is idle by now
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        closeIdleStreams();
+    }
+    if (m_initError == paNoError) {
+        std::lock_guard<std::mutex> lock(s_paMutex);
+        Pa_Terminate();
+    }
+}
+
+bool AudioRuntime::isInitialized() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_initError == paNoError;
+}
+
+std::vector<AudioDevice> AudioRuntime::getInputDevices() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_devices;
+}
+
+bool AudioRuntime::refreshDevices() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const CachedStream& cached : m_streams) {
+        if (cached.leased) {
+            m_refreshPending = true; // Done by release() once the last lease is back
+            return false;
+        }
+    }
+    reinitialize();
+    return m_initError == paNoError;
+}
+
+void AudioRuntime::reinitialize() {
+    m_refreshPending = false;
+
+    // Terminating closes every stream anyway, close the idle ones cleanly first
+    closeIdleStreams();
+    {
+        std::lock_guard<std::mutex> paLock(s_paMutex);
+        if (m_initError == paNoError) {
+            Pa_Terminate();
+        }
+        m_initError = Pa_Initialize();
+    }
+    if (m_initError != paNoError) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_initError) << std::endl;
+    }
+    enumerate();
+}
+
+PaDeviceIndex AudioRuntime::findInputDevice(const std::string& device) {
+    auto match = [this, &device]() -> PaDeviceIndex {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (device.empty()) {
+            for (const AudioDevice& candidate : m_devices) {
+                if (candidate.isDefault) {
+                    return candidate.id;
+                }
+            }
+            return paNoDevice;
+        }
+        if (std::all_of(device.begin(), device.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            PaDeviceIndex id = paNoDevice;
+            const char* end = device.data() + device.size();
+            const auto parsed = std::from_chars(device.data(), end, id);
+            if (parsed.ec != std::errc() || parsed.ptr != end) {
+                return paNoDevice; // Too long to be a device id
+            }
+            for (const AudioDevice& candidate : m_devices) {
+                if (candidate.id == id) {
+                    return id;
+                }
+            }
+            return paNoDevice;
+        }
+        for (const AudioDevice& candidate : m_devices) {
+            if (candidate.name == device) {
+                return candidate.id;
+            }
+        }
+        const std::string wanted = lower(device);
+        for (const AudioDevice& candidate : m_devices) {
+            if (lower(candidate.name).find(wanted) != std::string::npos) {
+                return candidate.id;
+            }
+        }
+        return paNoDevice;
+    };
+
+    PaDeviceIndex id = match();
+    if (id == paNoDevice && !device.empty() && refreshDevices()) {
+        id = match(); // Possibly plugged in since the last enumeration
+    }
+    return id;
+}
+
+std::unique_ptr<InputStreamLease> AudioRuntime::openInputStream(const InputStreamConfig& config, capture_callback callback, void* userData, PaError& err) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    err = m_initError;
+    if (err != paNoError) {
+        return nullptr;
+    }
+
+    // Same device and format as a stream released earlier: no open, no device negotiation
+    CachedStream* cached = nullptr;
+    for (CachedStream& candidate : m_streams) {
+        if (!candidate.leased && candidate.config == config) {
+            cached = &candidate;
+            break;
+        }
+    }
+
+    if (!cached) {
+        const PaDeviceInfo* info = Pa_GetDeviceInfo(config.device);
+        if (!info) {
+            err = paInvalidDevice;
+            return nullptr;
+        }
+        PaStreamParameters parameters;
+        parameters.device = config.device;
+        parameters.channelCount = config.channels; // Interleaved
+        parameters.sampleFormat = config.format;
+        parameters.suggestedLatency = info->defaultLowInputLatency;
+        parameters.hostApiSpecificStreamInfo = nullptr;
+
+        m_streams.emplace_back();
+        CachedStream& opened = m_streams.back();
+        opened.config = config;
+        err = Pa_OpenStream(
+            &opened.stream,
+            &parameters,
+            nullptr,
+            config.sampleRate,
+            config.framesPerBuffer,
+            paClipOff,
+            config.blocking ? nullptr : &AudioRuntime::dispatch,
+            config.blocking ? nullptr : &opened
+        );
+        if (err != paNoError) {
+            m_streams.pop_back();
+            return nullptr;
+        }
+        cached = &opened;
+    }
+
+    // The stream is stopped, so its callback target can change without racing the audio thread
+    cached->leased = true;
+    cached->callback = callback;
+    cached->userData = userData;
+    return std::unique_ptr<InputStreamLease>(new InputStreamLease(shared_from_this(), cached));
+}
+
+int AudioRuntime::dispatch(const void* inputBuffer, void* outputBuffer,
+    unsigned long framesPerBuffer,
+    const PaStreamCallbackTimeInfo* timeInfo,
+    PaStreamCallbackFlags statusFlags,
+    void* userData) {
+    auto* cached = static_cast<CachedStream*>(userData);
+    if (!cached->callback) {
+        return paComplete;
+    }
+
+    // The buffer was captured before the callback runs: step back by the age of its last frame, both in stream time
+    auto captured = std::chrono::steady_clock::now();
+    if (timeInfo && timeInfo->currentTime > 0 && timeInfo->inputBufferAdcTime > 0) {
+        const double age = timeInfo->currentTime - (timeInfo->inputBufferAdcTime + framesPerBuffer / cached->config.sampleRate);
+        if (age > 0 && age < 1.0) { // Anything else is a host API reporting times it doesn't have
+            captured -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(age));
+        }
+    }
+    return cached->callback(inputBuffer, framesPerBuffer, captured, cached->userData);
+}
+
+void AudioRuntime::release(CachedStream* cached) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cached->leased = false;
+    cached->callback = nullptr;
+    cached->userData = nullptr;
+
+    // Most recently released last, so the oldest idle streams are closed first
+    for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+        if (&*it == cached) {
+            m_streams.splice(m_streams.end(), m_streams, it);
+            break;
+        }
+    }
+    std::size_t idle = std::count_if(m_streams.begin(), m_streams.end(), [](const CachedStream& s) { return !s.leased; });
+    if (m_refreshPending && idle == m_streams.size()) {
+        reinitialize(); // Deferred refreshDevices, nothing is capturing any more
+        return;
+    }
+    for (auto it = m_streams.begin(); it != m_streams.end() && idle > s_maxIdleStreams;) {
+        if (it->leased) {
+            ++it;
+            continue;
+        }
+        Pa_CloseStream(it->stream);
+        it = m_streams.erase(it);
+        --idle;
+    }
+}
+
+void AudioRuntime::enumerate() {
+    m_devices.clear();
+    if (m_initError != paNoError) {
+        return;
+    }
+    const PaDeviceIndex defaultInput = Pa_GetDefaultInputDevice();
+    const PaDeviceIndex count = Pa_GetDeviceCount();
+    for (PaDeviceIndex id = 0; id < count; ++id) {
+        const PaDeviceInfo* info = Pa_GetDeviceInfo(id);
+        if (!info || info->maxInputChannels <= 0) {
+            continue;
+        }
+        const PaHostApiInfo* hostApi = Pa_GetHostApiInfo(info->hostApi);
+        m_devices.push_back(AudioDevice{
+            id,
+            info->name,
+            hostApi ? hostApi->name : "",
+            info->maxInputChannels,
+            info->defaultSampleRate,
+            info->defaultLowInputLatency,
+            id == defaultInput
+        });
+    }
+}
+
+void AudioRuntime::closeIdleStreams() {
+    for (auto it = m_streams.begin(); it != m_streams.end();) {
+        if (it->leased) {
+            ++it;
+            continue;
+        }
+        Pa_CloseStream(it->stream);
+        it = m_streams.erase(it);
+    }
+}
+
+
+InputStreamLease::InputStreamLease(std::shared_ptr<AudioRuntime> runtime, AudioRuntime::CachedStream* cached)
+    : m_runtime(std::move(runtime))
+    , m_cached(cached)
+{
+}
+
+InputStreamLease::~InputStreamLease() {
+    if (m_running) {
+        stop();
+    }
+    m_runtime->release(m_cached);
+}
+
+PaError InputStreamLease::start() {
+    // A callback that returned paComplete leaves the stream inactive but not stopped
+    if (Pa_IsStreamStopped(m_cached->stream) == 0) {
+        Pa_StopStream(m_cached->stream);
+    }
+    PaError err = Pa_StartStream(m_cached->stream);
+    m_running = err == paNoError;
+    return err;
+}
+
+PaError InputStreamLease::stop() {
+    m_running = false;
+    if (Pa_IsStreamStopped(m_cached->stream) == 1) {
+        return paNoError;
+    }
+    return Pa_StopStream(m_cached->stream);
+}
+
+PaStream* InputStreamLease::get() const {
+    return m_cached->stream;
+}
+
+const InputStreamConfig& InputStreamLease::getConfig() const {
+    return m_cached->config;
+}
@@ -0,0 +1,147 @@
+/**
+* @file AudioRuntime.h
+* @author zah
+* @brief Header for AudioRuntime: process-wide PortAudio runtime with cached devices and reusable input streams
+* @version 0.1
+* @date 2024-03-08
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef AUDIORUNTIME_H
+#define AUDIORUNTIME_H
+
+#include "portaudio.h"
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// @brief Input device as enumerated when PortAudio was (re)initialized
+struct AudioDevice {
+    PaDeviceIndex id; ///< PortAudio device index, valid until the next refresh
+    std::string name; ///< Device name
+    std::string hostApi; ///< Host API name (ALSA, JACK, WASAPI, ...)
+    int maxInputChannels; ///< Input channels the device offers
+    double defaultSampleRate; ///< Device default sample rate
+    PaTime defaultLowInputLatency; ///< Suggested latency used for capture streams
+    bool isDefault; ///< True for the host's default input device
+};
+
+/// @brief Parameters identifying a reusable input stream
+struct InputStreamConfig {
+    PaDeviceIndex device{ paNoDevice }; ///< Device from AudioRuntime::findInputDevice
+    int channels{ 1 }; ///< Interleaved input channels
+    PaSampleFormat format{ paInt16 }; ///< Sample format
+    double sampleRate{ 16000 }; ///< Sample rate
+    unsigned long framesPerBuffer{ 0 }; ///< Frames per callback or read
+    bool blocking{ false }; ///< Read with Pa_ReadStream instead of a callback
+
+    bool operator==(const InputStreamConfig& other) const;
+};
+
+/// @brief Capture callback of a leased stream: interleaved input, its frame count and when its last frame was captured, returns paContinue or paComplete
+///
+/// The capture time comes from PortAudio's inputBufferAdcTime, moved onto steady_clock; it is the callback's
+/// own time on host APIs that don't report ADC times.
+typedef int (*capture_callback)(const void* input, unsigned long frames, std::chrono::steady_clock::time_point captured, void* userData);
+
+class InputStreamLease;
+
+/// @brief Reference-counted PortAudio runtime shared by every capture user in the process
+///
+/// PortAudio is initialized when the first reference is acquired and terminated when the last one
+/// goes away, so sessions that cycle don't pay for host API and device enumeration each time.
+/// Input streams are kept open when released and handed out again for the same configuration.
+class AudioRuntime : public std::enable_shared_from_this<AudioRuntime> {
+public:
+    static std::shared_ptr<AudioRuntime> acquire(); ///< Returns the runtime, initializing PortAudio if nobody holds it
+    ~AudioRuntime(); ///< Closes cached streams and terminates PortAudio
+
+    AudioRuntime(const AudioRuntime&) = delete;
+    AudioRuntime& operator=(const AudioRuntime&) = delete;
+
+    bool isInitialized() const; ///< True if Pa_Initialize succeeded
+    std::vector<AudioDevice> getInputDevices() const; ///< Cached input devices
+
+    /// @brief Re-enumerates devices (PortAudio only sees hot-plugged devices after re-initializing)
+    ///
+    /// Re-initializing closes every stream, so while one is leased the refresh is deferred until the
+    /// last lease is released.
+    /// @return False if the refresh was deferred or PortAudio failed to initialize
+    bool refreshDevices();
+
+    /// @brief Resolves an input device: "" for the default, a number for a device id, otherwise a name
+    ///
+    /// Names match exactly first, then as a case-insensitive substring. A name that isn't found triggers
+    /// one refresh, in case the device was just plugged in (deferred while a stream is leased).
+    /// @return paNoDevice if nothing matches
+    PaDeviceIndex findInputDevice(const std::string& device);
+
+    /// @brief Leases an input stream, reusing a cached one with the same configuration when possible
+    /// @return nullptr (and PortAudio's error in err) if the stream couldn't be opened
+    std::unique_ptr<InputStreamLease> openInputStream(const InputStreamConfig& config, capture_callback callback, void* userData, PaError& err);
+
+private:
+    friend class InputStreamLease;
+
+    /// @brief Open stream owned by the runtime, with the callback target of its current lease
+    struct CachedStream {
+        InputStreamConfig config;
+        PaStream* stream{ nullptr };
+        capture_callback callback{ nullptr };
+        void* userData{ nullptr };
+        bool leased{ false };
+    };
+
+    AudioRuntime();
+
+    static int dispatch(
+        const void* inputBuffer,
+        void* outputBuffer,
+        unsigned long framesPerBuffer,
+        const PaStreamCallbackTimeInfo* timeInfo,
+        PaStreamCallbackFlags statusFlags,
+        void* userData
+    ); ///< PortAudio callback of every cached stream, forwards to the lease's callback
+
+    void release(CachedStream* cached); ///< Returns a leased stream to the cache
+    void reinitialize(); ///< Closes idle streams, re-initializes PortAudio and re-enumerates, m_mutex must be held with nothing leased
+    void enumerate(); ///< Fills m_devices, m_mutex must be held
+    void closeIdleStreams(); ///< Closes streams nobody leases, m_mutex must be held
+
+    static const std::size_t s_maxIdleStreams = 4; ///< Idle streams kept open (each holds its device)
+
+    mutable std::mutex m_mutex; ///< Mutex for protecting devices and streams
+    PaError m_initError{ paNoError }; ///< Result of the last Pa_Initialize
+    std::vector<AudioDevice> m_devices; ///< Cached input devices
+    bool m_refreshPending{ false }; ///< A refresh was asked for while a stream was leased
+    std::list<CachedStream> m_streams; ///< Open streams, a list so their addresses stay valid as callback data
+};
+
+/// @brief Exclusive use of a cached input stream, returned to the runtime on destruction
+class InputStreamLease {
+public:
+    ~InputStreamLease(); ///< Stops the stream if needed and returns it to the cache
+
+    InputStreamLease(const InputStreamLease&) = delete;
+    InputStreamLease& operator=(const InputStreamLease&) = delete;
+
+    PaError start(); ///< Starts capture
+    PaError stop(); ///< Stops capture, the stream stays open for the next start
+    PaStream* get() const; ///< PortAudio stream, for Pa_ReadStream on blocking streams
+    const InputStreamConfig& getConfig() const; ///< Configuration the stream was opened with
+
+private:
+    friend class AudioRuntime;
+    InputStreamLease(std::shared_ptr<AudioRuntime> runtime, AudioRuntime::CachedStream* cached);
+
+    std::shared_ptr<AudioRuntime> m_runtime; ///< Keeps PortAudio alive while the stream is used
+    AudioRuntime::CachedStream* m_cached; ///< Stream owned by the runtime
+    bool m_running{ false }; ///< Whether the stream is started
+};
+
+#endif // AUDIORUNTIME_H
@@ -0,0 +1,68 @@
+/**
+ * @file Benchmark.cpp
+ * @author zah
+ * @brief Implementation of BenchmarkRunner class
+ * @version 0.1
+ * @date 2024-01-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Benchmark.h"
+
+
+BenchmarkRunner::BenchmarkRunner(std::chrono::milliseconds sampleTime, std::string filter)
+    : m_sampleTime(sampleTime)
+    , m_filter(std::move(filter)) {}
+
+nlohmann::json BenchmarkRunner::toJSON() const {
+    nlohmann::json results = nlohmann::json::array();
+    for (const BenchmarkResult& result : m_results) {
+        results.push_back({
+            {"name", result.name},
+            {"iterations", result.iterations},
+            {"ns_per_op", result.nsPerOp},
+            {"ns_per_op_min", result.nsPerOpMin},
+            {"mb_per_s", result.mbPerSec},
+        });
+    }
+    return {
+        {"schema", 1},
+        {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()},
+        {"results", results},
+    };
+}
+
+int BenchmarkRunner::compare(const nlohmann::json& baseline, double threshold) const {
+    if (!baseline.is_object() || !baseline.contains("results") || !baseline["results"].is_array()) {
+        std::cerr << "Baseline has no results array" << std::endl;
+        return -1;
+    }
+    const nlohmann::json& previousResults = baseline["results"];
+
+    int regressions = 0;
+    for (const BenchmarkResult& result : m_results) {
+        // Match by name, benchmarks added since the baseline have nothing to compare with
+        auto previous = std::find_if(previousResults.begin(), previousResults.end(),
+            [&](const nlohmann::json& entry) { return entry.is_object() && entry.value("name", "") == result.name; });
+        if (previous == previousResults.end()) {
+            std::cout << result.name << ": new" << std::endl;
+            continue;
+        }
+
+        // A zero or missing time can't be compared with
+        const nlohmann::json& ns = previous->contains("ns_per_op") ? (*previous)["ns_per_op"] : nlohmann::json();
+        double before = ns.is_number() ? ns.get<double>() : 0.0;
+        if (before <= 0.0) {
+            std::cout << result.name << ": no usable baseline time" << std::endl;
+            continue;
+        }
+        double change = (result.nsPerOp - before) / before;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::cout << result.name << ": " << before << " -> " << result.nsPerOp << " ns/op ("
+                  << (change >= 0 ? "+" : "") << change * 100.0 << "%)"
+                  << (regressed ? " REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
@@ -0,0 +1,112 @@
+/**
+* @file Benchmark.h
+* @author zah
+* @brief Header for BenchmarkRunner class that times hot paths and records machine-readable results
+* @version 0.1
+* @date 2024-01-26
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// @brief Timing of one benchmark
+struct BenchmarkResult {
+    std::string name; ///< Unique name, used to match results across commits
+    uint64_t iterations{ 0 }; ///< Iterations per sample
+    double nsPerOp{ 0.0 }; ///< Median time per iteration over all samples
+    double nsPerOpMin{ 0.0 }; ///< Fastest sample's time per iteration
+    double mbPerSec{ 0.0 }; ///< Throughput at the median, 0 if the benchmark has no byte count
+};
+
+/// @brief Keeps the compiler from discarding a value computed only for timing
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+/// @brief Runs benchmarks, collects results and compares them with a previous run
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(std::chrono::milliseconds sampleTime, std::string filter); ///< Constructor for BenchmarkRunner class: sets time per sample and name filter
+
+    /// @brief Times fn (one iteration per call) and records the result
+    /// @param name Unique name of the benchmark
+    /// @param bytesPerOp Bytes processed per iteration (0 if throughput makes no sense)
+    /// @param fn Callable doing one iteration of the hot path
+    template <typename Fn>
+    void run(const std::string& name, std::size_t bytesPerOp, Fn&& fn);
+
+    nlohmann::json toJSON() const; ///< Returns every result in the results file format
+    int compare(const nlohmann::json& baseline, double threshold) const; ///< Prints the change against a previous results file and returns the number of regressions, -1 if it has no results
+
+private:
+    static constexpr int s_samples = 5; ///< Samples per benchmark, the median is reported
+
+    std::chrono::nanoseconds m_sampleTime; ///< Target duration of one sample
+    std::string m_filter; ///< Only benchmarks whose name contains this run
+    std::vector<BenchmarkResult> m_results; ///< Results in the order they ran
+};
+
+template <typename Fn>
+void BenchmarkRunner::run(const std::string& name, std::size_t bytesPerOp, Fn&& fn) {
+    using clock = std::chrono::steady_clock;
+    if (name.find(m_filter) == std::string::npos) {
+        return;
+    }
+
+    // Calibrate: double the batch size until one batch takes a sample's worth of time (this also warms up)
+    uint64_t iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        if (clock::now() - start >= m_sampleTime || iterations >= (uint64_t(1) << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int s = 0; s < s_samples; ++s) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+        samples.push_back(elapsed.count() / static_cast<double>(iterations));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = samples[s_samples / 2];
+    result.nsPerOpMin = samples.front();
+    result.mbPerSec = bytesPerOp ? (bytesPerOp / result.nsPerOp) * 1e9 / (1024.0 * 1024.0) : 0.0;
+    m_results.push_back(result);
+
+    std::cerr << name << ": " << result.nsPerOp << " ns/op";
+    if (bytesPerOp) {
+        std::cerr << " (" << result.mbPerSec << " MB/s)";
+    }
+    std::cerr << std::endl;
+}
+
+#endif // BENCHMARK_H
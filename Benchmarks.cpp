@@ -0,0 +1,265 @@
+/**
+* @file Benchmarks.cpp
+* @author zah
+* @brief Microbenchmarks of the capture, send and receive hot paths, no network or audio hardware needed
+* @version 0.1
+* @date 2024-01-26
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: Benchmarks [--out results.json] [--baseline previous.json] [--threshold 0.10] [--filter name] [--sample-ms 100]
+*        Benchmarks --audit-allocations [--channels 2]
+* Results are written as JSON; with --baseline the run fails (exit code 1) if a benchmark got slower than the threshold.
+* With --audit-allocations (build with -DALLOCATION_AUDIT) the steady-state capture, send and receive paths are
+* run instead, and the run fails if any of them allocates.
+*/
+
+#include "AllocationAudit.h"
+#include "Benchmark.h"
+#include "CallbackHandler.h"
+#include "CapturePipeline.h"
+#include "Deinterleave.h"
+#include "RealTimeTranscriber.h"
+#include "ToolSupport.h"
+#include "TranscriptChannel.h"
+
+#include <cstring>
+#include <fstream>
+#include <websocketpp/base64/base64.hpp>
+
+namespace ChatBot {
+    /// @brief Gives the benchmarks access to RealTimeTranscriber's hot paths
+    struct TranscriberBench {
+        /// @brief Sizes the buffers and marks every session open, as if start_transcription had connected
+        static void prepare(RealTimeTranscriber& t) {
+            t.prepare_buffers();
+            for (RealTimeTranscriber::ChannelSession& session : t.m_sessions) {
+                session.connection = RealTimeTranscriber::ConnectionState::OPEN;
+            }
+        }
+        static const std::string& build_audio_frame(RealTimeTranscriber& t, const std::vector<char>& audio) {
+            return t.build_audio_frame(audio.data(), audio.size());
+        }
+        static void enqueue_dequeue(RealTimeTranscriber& t, const std::vector<char>& audio) {
+            RealTimeTranscriber::AudioChunk chunk;
+            t.enqueue_audio_data(0, audio.data(), audio.size());
+            t.dequeue_audio_data(chunk);
+            t.release_audio_buffer(chunk.buffer);
+            doNotOptimize(chunk);
+        }
+        static void handle_message(RealTimeTranscriber& t, const std::string& payload) {
+            t.handle_message(0, payload);
+        }
+        /// @brief One capture callback, then what the send thread does with each queued chunk (minus the socket write)
+        static void capture_and_send(RealTimeTranscriber& t, const std::vector<char>& interleaved, unsigned long frames) {
+            t.m_isConnected.store(true);
+            t.on_audio_data(interleaved.data(), frames, std::chrono::steady_clock::now());
+            RealTimeTranscriber::AudioChunk chunk;
+            for (int channel = 0; channel < t.m_channels; ++channel) {
+                t.dequeue_audio_data(chunk);
+                ALLOCATION_AUDIT_SCOPE();
+                doNotOptimize(t.build_audio_frame(chunk.buffer->data(), chunk.buffer->size));
+                t.release_audio_buffer(chunk.buffer);
+            }
+            t.m_isConnected.store(false);
+        }
+    };
+} // namespace ChatBot
+
+using namespace ChatBot;
+
+namespace {
+    std::vector<char> make_pcm(std::size_t samples) {
+        std::vector<char> pcm(samples * sizeof(int16_t));
+        auto* data = reinterpret_cast<int16_t*>(pcm.data());
+        for (std::size_t i = 0; i < samples; ++i) {
+            data[i] = static_cast<int16_t>((i * 7919) % 65536 - 32768); // Deterministic, not compressible by accident
+        }
+        return pcm;
+    }
+
+    /// @brief Runs the steady-state audio and transcript paths with the allocation audit armed
+    /// @return Number of allocations made on those paths
+    uint64_t audit_allocations(int sampleRate, int channels, const std::string& partial, const std::string& final) {
+        const unsigned long frames = static_cast<unsigned long>(sampleRate * 0.2);
+        const std::vector<char> interleaved = make_pcm(frames * channels);
+
+        RealTimeTranscriber transcriber(sampleRate, channels);
+        TranscriberBench::prepare(transcriber);
+
+        // Warm-up: first-use allocations (stream buffers, transcript capacity) are allowed
+        for (int i = 0; i < 10; ++i) {
+            TranscriberBench::capture_and_send(transcriber, interleaved, frames);
+            TranscriberBench::handle_message(transcriber, partial);
+            TranscriberBench::handle_message(transcriber, final);
+        }
+
+        AllocationAudit::reset();
+        AllocationAudit::arm(true);
+        for (int i = 0; i < 1000; ++i) {
+            TranscriberBench::capture_and_send(transcriber, interleaved, frames);
+            TranscriberBench::handle_message(transcriber, partial);
+            TranscriberBench::handle_message(transcriber, final);
+        }
+        AllocationAudit::arm(false);
+        return AllocationAudit::getViolations();
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int SAMPLE_RATE = 16000;
+    const int FRAMES_PER_BUFFER = static_cast<int>(SAMPLE_RATE * 0.2); // Same chunk as RealTimeTranscriber
+
+    const std::string outPath = arg_value(argc, argv, "--out", "");
+    const std::string baselinePath = arg_value(argc, argv, "--baseline", "");
+    const double threshold = std::stod(arg_value(argc, argv, "--threshold", "0.10"));
+    BenchmarkRunner runner(std::chrono::milliseconds(std::stoi(arg_value(argc, argv, "--sample-ms", "100"))), arg_value(argc, argv, "--filter", ""));
+
+    const std::vector<char> pcm = make_pcm(FRAMES_PER_BUFFER);
+    const std::string partial = R"({"message_type":"PartialTranscript","audio_start":0,"audio_end":1500,"confidence":0.93,"text":"request vectors to runway two seven left","words":[],"created":"2024-01-26T10:00:00.000000"})";
+    const std::string final = R"({"message_type":"FinalTranscript","audio_start":0,"audio_end":2100,"confidence":0.97,"text":"Request vectors to runway two seven left.","words":[],"created":"2024-01-26T10:00:01.000000","punctuated":true,"text_formatted":true})";
+
+    // Allocation audit instead of timings. Transcripts go to the real console so printing is audited as in the client
+    // (redirect stdout when running it); the result goes to stderr
+    if (has_flag(argc, argv, "--audit-allocations")) {
+        if (!AllocationAudit::isAvailable()) {
+            std::cerr << "Allocation audit needs a build with -DALLOCATION_AUDIT" << std::endl;
+            return 1;
+        }
+        const int channels = std::stoi(arg_value(argc, argv, "--channels", "2"));
+        const uint64_t violations = audit_allocations(SAMPLE_RATE, channels, partial, final);
+        std::cerr << "Allocations on the audio and transcript paths: " << violations << std::endl;
+        return violations == 0 ? 0 : 1;
+    }
+
+    // The code under test prints every transcript, keep the results readable
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+    // Send path: PCM -> base64 -> JSON text frame
+    runner.run("send/base64_encode", pcm.size(), [&] {
+        doNotOptimize(websocketpp::base64_encode(reinterpret_cast<const unsigned char*>(pcm.data()), pcm.size()));
+    });
+    {
+        RealTimeTranscriber transcriber(SAMPLE_RATE);
+        TranscriberBench::prepare(transcriber);
+        runner.run("send/build_audio_frame", pcm.size(), [&] {
+            doNotOptimize(TranscriberBench::build_audio_frame(transcriber, pcm));
+        });
+        runner.run("send/queue_enqueue_dequeue", pcm.size(), [&] {
+            TranscriberBench::enqueue_dequeue(transcriber, pcm);
+        });
+
+        // Receive path: server message parsing and transcript diffing
+        runner.run("receive/on_message_partial", partial.size(), [&] {
+            TranscriberBench::handle_message(transcriber, partial);
+        });
+        runner.run("receive/on_message_final", final.size(), [&] {
+            TranscriberBench::handle_message(transcriber, final);
+        });
+    }
+
+    // Out-of-process consumers: one transcript event into the shared-memory ring and read back by a subscriber
+    {
+        TranscriptPublisher publisher("aai_bench_transcripts");
+        TranscriptSubscriber subscriber("aai_bench_transcripts");
+        TranscriptDiffer differ;
+        const std::string text = "the quick brown fox jumps over the lazy dog";
+        const TranscriptDelta& delta = differ.update(text, false);
+        TranscriptEvent event;
+        runner.run("receive/transcript_channel_publish_read", text.size(), [&] {
+            publisher.publish(0, delta, text);
+            subscriber.next(event);
+            doNotOptimize(event);
+        });
+    }
+
+    // Capture path: splitting interleaved input into per-channel buffers
+    for (int channels : { 1, 2, 4 }) {
+        std::vector<char> interleaved = make_pcm(FRAMES_PER_BUFFER * channels);
+        std::vector<std::vector<int16_t>> buffers(channels, std::vector<int16_t>(FRAMES_PER_BUFFER));
+        std::vector<int16_t*> targets;
+        for (auto& buffer : buffers) {
+            targets.push_back(buffer.data());
+        }
+        runner.run("capture/deinterleave_" + std::to_string(channels) + "ch", interleaved.size(), [&] {
+            deinterleave(reinterpret_cast<const int16_t*>(interleaved.data()), FRAMES_PER_BUFFER, channels, targets.data());
+            doNotOptimize(buffers);
+        });
+    }
+
+    // Capture pipelines: compile-time specialized against runtime-sized, for integer and float input
+    for (PaSampleFormat format : { paInt16, paFloat32 }) {
+        for (int channels : { 1, 2 }) {
+            std::vector<char> interleaved = make_pcm(FRAMES_PER_BUFFER * channels * (format == paFloat32 ? 2 : 1));
+            if (format == paFloat32) {
+                auto* samples = reinterpret_cast<float*>(interleaved.data());
+                for (int i = 0; i < FRAMES_PER_BUFFER * channels; ++i) {
+                    samples[i] = static_cast<float>((i * 7919) % 2001 - 1000) / 1000.0f;
+                }
+            }
+            const std::string suffix = std::string(format == paFloat32 ? "float32_" : "int16_") + std::to_string(channels) + "ch";
+
+            std::unique_ptr<CapturePipeline> fixed = make_capture_pipeline(format, channels, SAMPLE_RATE, std::chrono::milliseconds(200));
+            DynamicCapturePipeline dynamic(format, channels, FRAMES_PER_BUFFER);
+            runner.run("capture/pipeline_fixed_" + suffix, interleaved.size(), [&] {
+                doNotOptimize(fixed->split(interleaved.data(), FRAMES_PER_BUFFER));
+            });
+            runner.run("capture/pipeline_dynamic_" + suffix, interleaved.size(), [&] {
+                doNotOptimize(dynamic.split(interleaved.data(), FRAMES_PER_BUFFER));
+            });
+        }
+    }
+
+    // Python path: StreamPy's chunk to bytes copy (reading the chunk is a device read, not timed here) and CallbackHandler updates
+    {
+        const std::vector<int16_t> chunk(FRAMES_PER_BUFFER / 2, 1000);
+        runner.run("capture/mic_chunk_to_bytes", FRAMES_PER_BUFFER / 2 * sizeof(int16_t), [&] {
+            std::vector<uint8_t> bytes(chunk.size() * sizeof(int16_t));
+            std::memcpy(bytes.data(), chunk.data(), bytes.size());
+            doNotOptimize(bytes);
+        });
+    }
+    {
+        py::scoped_interpreter interpreter;
+        py::object transcript = py::module_::import("types").attr("SimpleNamespace");
+        py::object partialData = transcript("text"_a = "request vectors to runway two seven left", "message_type"_a = "PartialTranscript");
+        py::object finalData = transcript("text"_a = "Request vectors to runway two seven left.", "message_type"_a = "FinalTranscript");
+
+        CallbackHandler handler;
+        runner.run("receive/callback_on_data_partial", 0, [&] {
+            handler.on_data(partialData);
+        });
+        runner.run("receive/callback_on_data_final", 0, [&] {
+            handler.on_data(finalData);
+        });
+    }
+
+    std::cout.rdbuf(console);
+
+    // Machine-readable results
+    nlohmann::json results = runner.toJSON();
+    if (outPath.empty()) {
+        std::cout << results.dump(2) << std::endl;
+    }
+    else {
+        std::ofstream(outPath) << results.dump(2) << std::endl;
+    }
+
+    // Regression tracking against a previous run
+    if (!baselinePath.empty()) {
+        std::ifstream baselineFile(baselinePath);
+        if (!baselineFile) {
+            std::cerr << "Could not open baseline " << baselinePath << std::endl;
+            return 1;
+        }
+        const nlohmann::json baseline = nlohmann::json::parse(baselineFile, nullptr, false);
+        if (baseline.is_discarded()) {
+            std::cerr << "Baseline " << baselinePath << " isn't valid JSON" << std::endl;
+            return 1;
+        }
+        int regressions = runner.compare(baseline, threshold);
+        return regressions == 0 ? 0 : 1;
+    }
+    return 0;
+}
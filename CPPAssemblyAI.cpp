@@ -11,11 +11,55 @@
 
 #include "RealTimeTranscriber.h"
 
+#include <charconv>
+#include <cstring>
+
 using namespace ChatBot;
 
-int main() {
+namespace {
+    /// @brief Parses a whole argument as a number, false if it isn't one
+    template <typename T>
+    bool parse_number(const char* text, T& value) {
+        const char* end = text + std::strlen(text);
+        const std::from_chars_result result = std::from_chars(text, end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+
+    int usage(const char* error) {
+        std::cerr << "Usage: CPPAssemblyAI [channels] [record.rec] [device] [aggressiveness 0..1] [transcript channel]" << std::endl;
+        std::cerr << error << std::endl;
+        return 1;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
     const int SAMPLE_RATE = 16000;
-    std::unique_ptr<RealTimeTranscriber> transcriber; // Use smart pointer to manage resource
+    int CHANNELS = 1; // One transcription session per input channel
+    if (argc > 1 && (!parse_number(argv[1], CHANNELS) || CHANNELS < 1)) {
+        return usage("channels must be a positive integer");
+    }
+    const std::string DEVICE = argc > 3 ? argv[3] : ""; // Input device name or id, the default device if empty
+    double AGGRESSIVENESS = -1.0; // Client endpointing from 0 to 1, server endpointing if absent
+    if (argc > 4 && argv[4][0] != '\0' && (!parse_number(argv[4], AGGRESSIVENESS) || !(AGGRESSIVENESS >= 0.0 && AGGRESSIVENESS <= 1.0))) {
+        return usage("aggressiveness must be a number from 0 to 1");
+    }
+    const std::string TRANSCRIPT_CHANNEL = argc > 5 ? argv[5] : ""; // Shared-memory transcript channel for other processes, none if empty
+
+    // Held for the whole run, so PortAudio is initialized once and the capture stream is reused by every cycle
+    std::shared_ptr<AudioRuntime> audio = AudioRuntime::acquire();
+    for (const AudioDevice& device : audio->getInputDevices()) {
+        std::cout << (device.isDefault ? "* " : "  ") << device.id << ": " << device.name << " (" << device.hostApi << ", " << device.maxInputChannels << " ch)\n";
+    }
+
+    // One transcriber for the whole run: every start after the first reconnects it and reuses its capture stream
+    std::unique_ptr<RealTimeTranscriber> transcriber = std::make_unique<RealTimeTranscriber>(SAMPLE_RATE, CHANNELS);
+    transcriber->set_input_device(DEVICE);
+    if (AGGRESSIVENESS >= 0.0) {
+        transcriber->set_endpointing(EndpointingConfig::with_aggressiveness(AGGRESSIVENESS));
+    }
+    if (!TRANSCRIPT_CHANNEL.empty()) {
+        transcriber->enable_transcript_channel(TRANSCRIPT_CHANNEL); // One publisher for the whole run, readers stay attached across cycles
+    }
 
     while (true) {
         std::cout << "Press enter to start transcription\n";
@@ -23,7 +67,9 @@ int main() {
         
         {
             auto start_time = std::chrono::high_resolution_clock::now(); // Start timing
-            transcriber = std::make_unique<RealTimeTranscriber>(SAMPLE_RATE);
+            if (argc > 2 && argv[2][0] != '\0') {
+                transcriber->enable_recording(argv[2]); // Session log for SessionReplay, rewritten every cycle
+            }
             transcriber->start_transcription();
             auto end_time = std::chrono::high_resolution_clock::now(); // End timing
             std::cout << "Transcription started in " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << "ms" << std::endl;
@@ -37,6 +83,11 @@ int main() {
             transcriber->stop_transcription();
             auto end_time = std::chrono::high_resolution_clock::now(); // End timing
             std::cout << "Transcription stopped in " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << "ms" << std::endl;
+            for (int channel = 0; channel < CHANNELS; ++channel) {
+                EndpointingStats stats = transcriber->get_endpointing_stats(channel);
+                std::cout << "Channel " << channel << ": " << stats.finals << " finals (" << stats.forcedFinals << " forced), end of speech to final p50 "
+                          << stats.p50Ms << " ms, p90 " << stats.p90Ms << " ms" << std::endl;
+            }
         }
         
         std::string input;
@@ -28,13 +28,15 @@ void CallbackHandler::on_data(py::object transcript) {
     std::string message_type = transcript.attr("message_type").cast<std::string>();
     if (message_type == "FinalTranscript") {
         m_activity = Activity::FINAL;
+        m_transcriptDiff.update(text, true);
         m_finalTranscript = text;
         m_fullTranscript += text;
         std::cout << "Updated full transcript with : " << m_finalTranscript << std::endl;
     }
     else {
         m_activity = Activity::PARTIAL;
-        m_partialTranscript = text;
+        const TranscriptDelta& delta = m_transcriptDiff.update(text, false);
+        m_partialTranscript.replace(delta.stablePrefix, std::string::npos, delta.suffix);
         std::cout << "Updated partial transcript : " << m_partialTranscript << std::endl;
     }
 }
@@ -64,6 +66,10 @@ const std::string& CallbackHandler::getError() const {
 	return m_error;
 }
 
+const TranscriptDelta& CallbackHandler::getTranscriptDelta() const {
+    return m_transcriptDiff.getDelta();
+}
+
 Activity CallbackHandler::getActivity() const {
     return m_activity;
 }
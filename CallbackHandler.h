@@ -13,6 +13,7 @@
 
 #include <string>
 #include <iostream>
+#include "TranscriptDiff.h"
 #include "pybind11/embed.h"
 #include "pybind11/pybind11.h"
 
@@ -43,6 +44,7 @@ public:
     const std::string& getFinalTranscript() const; ///< Returns final transcript
     const std::string& getFullTranscript() const; ///< Returns full transcript
     const std::string& getError() const; ///< Returns error message from AssemblyAI
+    const TranscriptDelta& getTranscriptDelta() const; ///< Returns change since the previous transcript of the utterance
     Activity getActivity() const; ///< True if user isn't speaking
 
 private:
@@ -51,5 +53,6 @@ private:
     mutable std::string m_finalTranscript; ///< Final transcript
     mutable std::string m_fullTranscript; ///< Full transcript
     mutable std::string m_error; ///< Error message from AssemblyAI
+    TranscriptDiffer m_transcriptDiff; ///< Word-aligned diff between consecutive transcripts
 };
 #endif // CALLBACKHANDLER_H
\ No newline at end of file
@@ -0,0 +1,95 @@
+/**
+ * @file CapturePipeline.cpp
+ * @author zah
+ * @brief Implementation of the runtime-sized capture pipeline and the pipeline factory
+ * @version 0.1
+ * @date 2024-03-01
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "CapturePipeline.h"
+
+
+namespace {
+    template <typename Sample>
+    void convert_channels(const Sample* in, std::size_t frames, int channels, int16_t* const* out) {
+        for (int c = 0; c < channels; ++c) {
+            int16_t* dst = out[c];
+            for (std::size_t f = 0; f < frames; ++f) {
+                dst[f] = SampleTraits<Sample>::to_pcm16(in[f * channels + c]);
+            }
+        }
+    }
+
+    template <typename Sample, std::size_t ChunkFrames>
+    std::unique_ptr<CapturePipeline> make_fixed(int channels) {
+        switch (channels) {
+        case 1: return std::make_unique<FixedCapturePipeline<Sample, 1, ChunkFrames>>();
+        case 2: return std::make_unique<FixedCapturePipeline<Sample, 2, ChunkFrames>>();
+        case 4: return std::make_unique<FixedCapturePipeline<Sample, 4, ChunkFrames>>();
+        default: return nullptr;
+        }
+    }
+
+    // 100 and 200 ms at 8, 16 and 48 kHz
+    template <typename Sample>
+    std::unique_ptr<CapturePipeline> make_fixed(int channels, std::size_t chunkFrames) {
+        switch (chunkFrames) {
+        case 800: return make_fixed<Sample, 800>(channels);
+        case 1600: return make_fixed<Sample, 1600>(channels);
+        case 3200: return make_fixed<Sample, 3200>(channels);
+        case 4800: return make_fixed<Sample, 4800>(channels);
+        case 9600: return make_fixed<Sample, 9600>(channels);
+        default: return nullptr;
+        }
+    }
+} // namespace
+
+DynamicCapturePipeline::DynamicCapturePipeline(PaSampleFormat format, int channels, std::size_t chunkFrames)
+    : m_format(format)
+    , m_channels(channels)
+    , m_chunkFrames(chunkFrames)
+    , m_out(channels, std::vector<int16_t>(chunkFrames))
+{
+    for (std::vector<int16_t>& out : m_out) {
+        m_targets.push_back(out.data());
+    }
+}
+
+std::size_t DynamicCapturePipeline::split(const void* input, std::size_t frames) {
+    frames = frames < m_chunkFrames ? frames : m_chunkFrames;
+    if (m_format == paInt16) {
+        deinterleave(static_cast<const int16_t*>(input), frames, m_channels, m_targets.data());
+    }
+    else if (m_format == paInt32) {
+        convert_channels(static_cast<const int32_t*>(input), frames, m_channels, m_targets.data());
+    }
+    else {
+        convert_channels(static_cast<const float*>(input), frames, m_channels, m_targets.data());
+    }
+    return frames * sizeof(int16_t);
+}
+
+std::unique_ptr<CapturePipeline> make_capture_pipeline(PaSampleFormat format, int channels, int sampleRate, std::chrono::milliseconds chunk) {
+    if ((format != paInt16 && format != paInt32 && format != paFloat32) || channels < 1) {
+        return nullptr;
+    }
+
+    const std::size_t chunkFrames = static_cast<std::size_t>(sampleRate) * chunk.count() / 1000;
+    std::unique_ptr<CapturePipeline> pipeline;
+    if (format == paInt16) {
+        pipeline = make_fixed<int16_t>(channels, chunkFrames);
+    }
+    else if (format == paInt32) {
+        pipeline = make_fixed<int32_t>(channels, chunkFrames);
+    }
+    else {
+        pipeline = make_fixed<float>(channels, chunkFrames);
+    }
+
+    if (!pipeline) {
+        pipeline = std::make_unique<DynamicCapturePipeline>(format, channels, chunkFrames);
+    }
+    return pipeline;
+}
@@ -0,0 +1,157 @@
+/**
+* @file CapturePipeline.h
+* @author zah
+* @brief Header for CapturePipeline: turns interleaved capture buffers into per-channel PCM16 chunks
+* @version 0.1
+* @date 2024-03-01
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef CAPTUREPIPELINE_H
+#define CAPTUREPIPELINE_H
+
+#include "portaudio.h"
+#include "Deinterleave.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/// @brief Capture sample types and their conversion to the PCM16 the real-time API expects
+template <typename Sample>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<int16_t> {
+    static constexpr PaSampleFormat format = paInt16;
+    static int16_t to_pcm16(int16_t s) { return s; }
+};
+
+template <>
+struct SampleTraits<int32_t> {
+    static constexpr PaSampleFormat format = paInt32;
+    static int16_t to_pcm16(int32_t s) { return static_cast<int16_t>(s >> 16); }
+};
+
+template <>
+struct SampleTraits<float> {
+    static constexpr PaSampleFormat format = paFloat32;
+    static int16_t to_pcm16(float s) {
+        // Clamp after scaling, written as selects so the loop vectorizes; NaN fails both clamps, so it becomes silence first
+        float scaled = s * 32767.0f;
+        scaled = scaled == scaled ? scaled : 0.0f;
+        scaled = scaled < -32768.0f ? -32768.0f : scaled;
+        scaled = scaled > 32767.0f ? 32767.0f : scaled;
+        return static_cast<int16_t>(scaled);
+    }
+};
+
+/// @brief Splits and converts one interleaved capture buffer into a PCM16 chunk per channel
+///
+/// Called once per capture callback; the per-sample work happens inside the implementation.
+class CapturePipeline {
+public:
+    virtual ~CapturePipeline() = default;
+
+    virtual PaSampleFormat format() const = 0; ///< PortAudio sample format of the input
+    virtual int channels() const = 0; ///< Interleaved channels of the input
+    virtual std::size_t chunk_frames() const = 0; ///< Frames per chunk (and per capture callback)
+    virtual bool is_specialized() const = 0; ///< True if sizes and channel count are compile-time constants
+
+    /// @brief Converts up to chunk_frames() interleaved frames
+    /// @return Bytes of PCM16 now held for each channel
+    virtual std::size_t split(const void* input, std::size_t frames) = 0;
+    virtual const char* channel_data(int channel) const = 0; ///< PCM16 chunk of a channel from the last split
+};
+
+/// @brief Pipeline specialized on sample type, channel count and chunk size
+///
+/// Output buffers are arrays sized at compile time and the channel stride is a constant,
+/// so each loop is a straight conversion the compiler can vectorize.
+template <typename Sample, int Channels, std::size_t ChunkFrames>
+class FixedCapturePipeline final : public CapturePipeline {
+public:
+    static constexpr std::size_t s_chunkBytes = ChunkFrames * sizeof(int16_t); ///< PCM16 bytes per channel chunk
+    static constexpr std::size_t s_inputBytes = ChunkFrames * Channels * sizeof(Sample); ///< Bytes of one capture buffer
+
+    FixedCapturePipeline() {
+        for (int c = 0; c < Channels; ++c) {
+            m_targets[c] = m_out[c].data();
+        }
+    }
+
+    PaSampleFormat format() const override { return SampleTraits<Sample>::format; }
+    int channels() const override { return Channels; }
+    std::size_t chunk_frames() const override { return ChunkFrames; }
+    bool is_specialized() const override { return true; }
+
+    std::size_t split(const void* input, std::size_t frames) override {
+        const auto* in = static_cast<const Sample*>(input);
+        if (frames >= ChunkFrames) {
+            convert(in, std::integral_constant<std::size_t, ChunkFrames>{}); // Full chunk, the usual case: the trip count is a constant too
+            return s_chunkBytes;
+        }
+        convert(in, frames);
+        return frames * sizeof(int16_t);
+    }
+
+    const char* channel_data(int channel) const override { return reinterpret_cast<const char*>(m_out[channel].data()); }
+
+private:
+    template <typename Count>
+    void convert(const Sample* in, Count frames) {
+        if constexpr (std::is_same<Sample, int16_t>::value && Channels == 1) {
+            std::memcpy(m_out[0].data(), in, frames * sizeof(int16_t));
+        }
+        else if constexpr (std::is_same<Sample, int16_t>::value) {
+            deinterleave(in, frames, Channels, m_targets.data()); // Hand-written SSE2 for 2 and 4 channels
+        }
+        else {
+            // Frame by frame with the channel loop unrolled: every input sample is read once, in order
+            for (std::size_t f = 0; f < frames; ++f) {
+                for (int c = 0; c < Channels; ++c) {
+                    m_out[c][f] = SampleTraits<Sample>::to_pcm16(in[f * Channels + c]);
+                }
+            }
+        }
+    }
+
+    std::array<std::array<int16_t, ChunkFrames>, Channels> m_out{}; ///< PCM16 chunk of each channel
+    std::array<int16_t*, Channels> m_targets{}; ///< De-interleaving targets, point into m_out
+};
+
+/// @brief Runtime-sized pipeline for configurations without a specialization
+class DynamicCapturePipeline final : public CapturePipeline {
+public:
+    DynamicCapturePipeline(PaSampleFormat format, int channels, std::size_t chunkFrames);
+
+    PaSampleFormat format() const override { return m_format; }
+    int channels() const override { return m_channels; }
+    std::size_t chunk_frames() const override { return m_chunkFrames; }
+    bool is_specialized() const override { return false; }
+
+    std::size_t split(const void* input, std::size_t frames) override;
+    const char* channel_data(int channel) const override { return reinterpret_cast<const char*>(m_out[channel].data()); }
+
+private:
+    const PaSampleFormat m_format; ///< Input sample format
+    const int m_channels; ///< Interleaved channels
+    const std::size_t m_chunkFrames; ///< Frames per chunk
+    std::vector<std::vector<int16_t>> m_out; ///< PCM16 chunk of each channel
+    std::vector<int16_t*> m_targets; ///< De-interleaving targets, point into m_out
+};
+
+/// @brief Picks the pipeline for a capture configuration
+///
+/// int16, int32 and float32 input with 1, 2 or 4 channels and 100 or 200 ms chunks at 8, 16 or 48 kHz
+/// get a FixedCapturePipeline; other channel counts and chunk sizes fall back to DynamicCapturePipeline.
+/// @return nullptr if the sample format isn't supported
+std::unique_ptr<CapturePipeline> make_capture_pipeline(PaSampleFormat format, int channels, int sampleRate, std::chrono::milliseconds chunk);
+
+#endif // CAPTUREPIPELINE_H
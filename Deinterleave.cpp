@@ -0,0 +1,90 @@
+/**
+ * @file Deinterleave.cpp
+ * @author zah
+ * @brief Implementation of PCM16 de-interleaving
+ * @version 0.1
+ * @date 2024-01-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Deinterleave.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEINTERLEAVE_SSE2 1
+#endif
+
+
+namespace {
+    void deinterleave_scalar(const int16_t* in, std::size_t first, std::size_t frames, int channels, int16_t* const* out) {
+        for (int c = 0; c < channels; ++c) {
+            int16_t* dst = out[c];
+            for (std::size_t f = first; f < frames; ++f) {
+                dst[f] = in[f * channels + c];
+            }
+        }
+    }
+
+#ifdef DEINTERLEAVE_SSE2
+    // Splits 8 interleaved (even, odd) int16 pairs held in a and b into 8 evens and 8 odds.
+    // Sign-extending each 32-bit lane's halves and packing back with saturation is exact.
+    inline void split_pairs(__m128i a, __m128i b, __m128i& even, __m128i& odd) {
+        even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    }
+
+    std::size_t deinterleave_stereo(const int16_t* in, std::size_t frames, int16_t* left, int16_t* right) {
+        std::size_t f = 0;
+        for (; f + 8 <= frames; f += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * f));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * f + 8));
+            __m128i l, r;
+            split_pairs(a, b, l, r);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left + f), l);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right + f), r);
+        }
+        return f;
+    }
+
+    std::size_t deinterleave_quad(const int16_t* in, std::size_t frames, int16_t* const* out) {
+        std::size_t f = 0;
+        for (; f + 8 <= frames; f += 8) {
+            // 8 frames of 4 channels: each 32-bit lane holds a (c0,c1) or (c2,c3) pair
+            const __m128i* src = reinterpret_cast<const __m128i*>(in + 4 * f);
+            __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128(src + 0), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128(src + 1), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i v2 = _mm_shuffle_epi32(_mm_loadu_si128(src + 2), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i v3 = _mm_shuffle_epi32(_mm_loadu_si128(src + 3), _MM_SHUFFLE(3, 1, 2, 0));
+
+            // Gather the (c0,c1) pairs and the (c2,c3) pairs, 4 frames per register
+            __m128i p01a = _mm_unpacklo_epi64(v0, v1);
+            __m128i p23a = _mm_unpackhi_epi64(v0, v1);
+            __m128i p01b = _mm_unpacklo_epi64(v2, v3);
+            __m128i p23b = _mm_unpackhi_epi64(v2, v3);
+
+            __m128i c0, c1, c2, c3;
+            split_pairs(p01a, p01b, c0, c1);
+            split_pairs(p23a, p23b, c2, c3);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[0] + f), c0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[1] + f), c1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[2] + f), c2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[3] + f), c3);
+        }
+        return f;
+    }
+#endif
+} // namespace
+
+void deinterleave(const int16_t* in, std::size_t frames, int channels, int16_t* const* out) {
+    std::size_t done = 0;
+#ifdef DEINTERLEAVE_SSE2
+    if (channels == 2) {
+        done = deinterleave_stereo(in, frames, out[0], out[1]);
+    }
+    else if (channels == 4) {
+        done = deinterleave_quad(in, frames, out);
+    }
+#endif
+    deinterleave_scalar(in, done, frames, channels, out);
+}
@@ -0,0 +1,28 @@
+/**
+* @file Deinterleave.h
+* @author zah
+* @brief Header for splitting interleaved multi-channel PCM16 into per-channel buffers
+* @version 0.1
+* @date 2024-01-19
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef DEINTERLEAVE_H
+#define DEINTERLEAVE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// @brief Splits interleaved PCM16 frames into one contiguous buffer per channel
+///
+/// Stereo and 4-channel input use SSE2 when it is available, other channel counts
+/// and the tail of each buffer go through a plain loop.
+///
+/// @param in Interleaved samples (frames * channels values)
+/// @param frames Number of frames in the input
+/// @param channels Number of channels per frame
+/// @param out Array of channels pointers, each with room for frames samples
+void deinterleave(const int16_t* in, std::size_t frames, int channels, int16_t* const* out);
+
+#endif // DEINTERLEAVE_H
@@ -0,0 +1,218 @@
+/**
+* @file EndpointBench.cpp
+* @author zah
+* @brief Measures end-of-speech to final latency with server-only and client-driven endpointing
+* @version 0.1
+* @date 2024-03-15
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: EndpointBench <cert.pem> <key.pem> [--utterances 10] [--port 9445] [--server-threshold-ms 700] [--aggressiveness 0,0.5,1] [--out endpointing.json]
+* Synthetic utterances (1.2 s of tone, then 1.5 s of near silence) are pushed in 100 ms chunks at real-time pace into a
+* RealTimeTranscriber. The stand-in server endpoints like the real service: a partial per chunk, then the final once it
+* has received its silence threshold of quiet audio, or right away on force_end_utterance. Each mode reports the
+* transcriber's own capture-to-final latency: from the capture of the last chunk with speech to the arrival of the final.
+*/
+
+#include "RealTimeTranscriber.h"
+#include "StandInServer.h"
+#include "ToolSupport.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <websocketpp/base64/base64.hpp>
+
+using namespace ChatBot;
+
+namespace {
+    /// @brief Server-side endpointing of the stand-in: counts words while there's speech, finals after enough silence
+    struct ServerEndpointing {
+        std::mutex mutex;
+        int thresholdMs{ 700 }; ///< end_utterance_silence_threshold, the service's default until the client sets it
+        int silentMs{ 0 }; ///< Quiet audio received since the last word
+        int words{ 0 }; ///< Words of the current utterance, one per chunk with speech
+    };
+
+    std::string transcript(const char* type, int words) {
+        std::string text;
+        for (int i = 1; i <= words; ++i) {
+            text += (i > 1 ? " w" : "w") + std::to_string(i);
+        }
+        return nlohmann::json{ {"message_type", type}, {"text", text} }.dump();
+    }
+
+    /// @brief Same gate as the client's endpointer, so both sides agree on which chunks are speech
+    bool is_speech(const std::string& pcm) {
+        const double threshold = EndpointingConfig{}.energyThreshold;
+        const auto* samples = reinterpret_cast<const int16_t*>(pcm.data());
+        const std::size_t count = pcm.size() / sizeof(int16_t);
+        double energy = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            energy += double(samples[i]) * samples[i];
+        }
+        return count > 0 && energy / count >= threshold * threshold;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::steady_clock;
+    if (argc < 3) {
+        std::cerr << "Usage: EndpointBench <cert.pem> <key.pem> [--utterances 10] [--port 9445] [--server-threshold-ms 700] [--aggressiveness 0,0.5,1] [--out endpointing.json]" << std::endl;
+        return 1;
+    }
+
+    const int SAMPLE_RATE = 16000;
+    const int CHUNK_MS = 100;
+    const int FRAMES_PER_CHUNK = SAMPLE_RATE * CHUNK_MS / 1000;
+    const int SPEECH_CHUNKS = 12;
+    const int SILENCE_CHUNKS = 15;
+    const int utterances = std::stoi(arg_value(argc, argv, "--utterances", "10"));
+    const unsigned short port = static_cast<unsigned short>(std::stoi(arg_value(argc, argv, "--port", "9445")));
+    const int serverThresholdMs = std::stoi(arg_value(argc, argv, "--server-threshold-ms", "700"));
+    const std::string outPath = arg_value(argc, argv, "--out", "");
+
+    // Modes: the server alone, then client endpointing at each aggressiveness
+    std::vector<double> aggressiveness{ -1.0 };
+    std::stringstream levels(arg_value(argc, argv, "--aggressiveness", "0,0.5,1"));
+    for (std::string level; std::getline(levels, level, ',');) {
+        aggressiveness.push_back(std::stod(level));
+    }
+
+    // A 440 Hz tone stands in for speech, low noise for silence
+    std::vector<char> speech(FRAMES_PER_CHUNK * sizeof(int16_t)), silence(FRAMES_PER_CHUNK * sizeof(int16_t));
+    auto* tone = reinterpret_cast<int16_t*>(speech.data());
+    auto* noise = reinterpret_cast<int16_t*>(silence.data());
+    for (int i = 0; i < FRAMES_PER_CHUNK; ++i) {
+        tone[i] = static_cast<int16_t>(4000 * std::sin(2 * 3.14159265358979 * 440 * i / SAMPLE_RATE));
+        noise[i] = static_cast<int16_t>((i * 7919) % 61 - 30);
+    }
+
+    ServerEndpointing endpointing;
+    StandInServer server(port, argv[1], argv[2]);
+    server.set_auto_reply(false);
+    server.set_frame_handler([&](int channel, const std::string& payload) {
+        std::string reply;
+        {
+            std::lock_guard<std::mutex> lock(endpointing.mutex);
+            std::string audio;
+            if (json_find_string(payload, "audio_data", audio)) {
+                if (is_speech(websocketpp::base64_decode(audio))) {
+                    endpointing.words++;
+                    endpointing.silentMs = 0;
+                    reply = transcript("PartialTranscript", endpointing.words);
+                }
+                else if (endpointing.words > 0) {
+                    endpointing.silentMs += CHUNK_MS;
+                    const bool final = endpointing.silentMs >= endpointing.thresholdMs;
+                    reply = transcript(final ? "FinalTranscript" : "PartialTranscript", endpointing.words);
+                    endpointing.words = final ? 0 : endpointing.words;
+                }
+            }
+            else {
+                nlohmann::json json_msg = nlohmann::json::parse(payload, nullptr, false);
+                if (json_msg.contains("end_utterance_silence_threshold")) {
+                    endpointing.thresholdMs = json_msg["end_utterance_silence_threshold"];
+                }
+                else if (json_msg.contains("force_end_utterance") && endpointing.words > 0) {
+                    reply = transcript("FinalTranscript", endpointing.words);
+                    endpointing.words = 0;
+                }
+            }
+        }
+        if (!reply.empty()) {
+            server.send(channel, reply);
+        }
+    });
+    if (!server.start()) {
+        return 1;
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+    nlohmann::json results = nlohmann::json::array();
+    double serverP50 = 0.0;
+    for (double level : aggressiveness) {
+        const bool client = level >= 0.0;
+        std::ostringstream mode;
+        mode << (client ? "client_" : "server");
+        if (client) {
+            mode << level;
+        }
+        {
+            std::lock_guard<std::mutex> lock(endpointing.mutex);
+            endpointing.thresholdMs = serverThresholdMs;
+            endpointing.silentMs = 0;
+            endpointing.words = 0;
+        }
+
+        RealTimeTranscriber transcriber(SAMPLE_RATE, 1, paInt16, std::chrono::milliseconds(CHUNK_MS));
+        transcriber.set_endpoint(server.uri());
+        transcriber.set_audio_source(AudioSource::EXTERNAL);
+        transcriber.set_endpointing(client ? EndpointingConfig::with_aggressiveness(level) : EndpointingConfig{});
+        transcriber.start_transcription();
+
+        clock::time_point deadline = clock::now() + std::chrono::seconds(10);
+        while (!transcriber.is_session_open(0) && clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!transcriber.is_session_open(0)) {
+            std::cerr << "Mode " << mode.str() << " did not connect to the stand-in server" << std::endl;
+            transcriber.stop_transcription();
+            continue;
+        }
+
+        // Real-time pace: endpointing decisions are made on wall-clock silence
+        clock::time_point next = clock::now();
+        for (int u = 0; u < utterances; ++u) {
+            for (int c = 0; c < SPEECH_CHUNKS + SILENCE_CHUNKS; ++c) {
+                std::this_thread::sleep_until(next);
+                next += std::chrono::milliseconds(CHUNK_MS);
+                transcriber.push_audio(0, c < SPEECH_CHUNKS ? speech : silence);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        const EndpointingStats stats = transcriber.get_endpointing_stats(0);
+        transcriber.stop_transcription();
+
+        if (!client) {
+            serverP50 = stats.p50Ms;
+        }
+        results.push_back({
+            {"mode", mode.str()},
+            {"aggressiveness", client ? nlohmann::json(level) : nlohmann::json()},
+            {"finals", stats.finals},
+            {"forced_finals", stats.forcedFinals},
+            {"capture_to_final_ms", {
+                {"p50", stats.p50Ms},
+                {"p90", stats.p90Ms},
+                {"max", stats.maxMs},
+            }},
+        });
+        std::cerr << mode.str() << ": " << stats.finals << " finals (" << stats.forcedFinals << " forced), p50 " << stats.p50Ms
+                  << " ms, p90 " << stats.p90Ms << " ms";
+        if (client && serverP50 > 0) {
+            std::cerr << ", " << static_cast<int>(100 * (serverP50 - stats.p50Ms) / serverP50) << "% below server endpointing";
+        }
+        std::cerr << std::endl;
+    }
+
+    std::cout.rdbuf(console);
+    server.stop();
+
+    nlohmann::json report = {
+        {"schema", 1},
+        {"chunk_ms", CHUNK_MS},
+        {"utterances", utterances},
+        {"server_threshold_ms", serverThresholdMs},
+        {"results", results},
+    };
+    if (outPath.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    }
+    else {
+        std::ofstream(outPath) << report.dump(2) << std::endl;
+    }
+    return 0;
+}
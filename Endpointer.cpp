@@ -0,0 +1,109 @@
+/**
+ * @file Endpointer.cpp
+ * @author zah
+ * @brief Implementation of Endpointer class
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Endpointer.h"
+
+#include <algorithm>
+#include <vector>
+
+
+EndpointingConfig EndpointingConfig::with_aggressiveness(double aggressiveness) {
+    const double a = std::min(1.0, std::max(0.0, aggressiveness));
+    EndpointingConfig config;
+    config.trailingSilence = std::chrono::milliseconds(static_cast<int64_t>(600 - 450 * a)); // 600 to 150 ms
+    config.stablePartial = std::chrono::milliseconds(static_cast<int64_t>(400 - 300 * a)); // 400 to 100 ms
+    config.serverSilenceThreshold = std::chrono::milliseconds(static_cast<int64_t>(1000 - 500 * a)); // 1000 to 500 ms
+    return config;
+}
+
+void Endpointer::configure(const EndpointingConfig& config) {
+    m_config = config;
+    m_phase = Phase::IDLE;
+    m_hasPartial = false;
+    m_forced = false;
+    m_finals = 0;
+    m_forcedFinals = 0;
+    m_latenciesUs.reset(s_historySize);
+}
+
+void Endpointer::on_audio(bool voiced, time_point captured) {
+    if (!voiced) {
+        return;
+    }
+    m_lastVoiced = captured;
+    if (m_phase == Phase::IDLE) {
+        m_phase = Phase::SPEAKING;
+    }
+}
+
+void Endpointer::on_partial(bool changed, time_point received) {
+    if (changed || !m_hasPartial) {
+        m_partialChanged = received;
+    }
+    m_hasPartial = true;
+}
+
+void Endpointer::on_final(bool has_text, time_point received) {
+    if (m_phase != Phase::IDLE && has_text) {
+        const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(received - m_lastVoiced).count();
+        if (m_latenciesUs.full()) {
+            m_latenciesUs.pop_front();
+        }
+        m_latenciesUs.push_back(static_cast<uint32_t>(std::max<int64_t>(0, us)));
+        m_finals++;
+        if (m_forced) {
+            m_forcedFinals++;
+        }
+    }
+    m_phase = Phase::IDLE;
+    m_hasPartial = false;
+    m_forced = false;
+}
+
+void Endpointer::on_reconnect() {
+    if (m_phase == Phase::ENDING) {
+        m_phase = Phase::SPEAKING;
+    }
+    m_hasPartial = false;
+    m_forced = false;
+}
+
+bool Endpointer::should_end(time_point now) const {
+    // Silence alone could be a pause mid-sentence; a settled partial means the server has transcribed what was said
+    return m_config.trailingSilence.count() > 0
+        && m_phase == Phase::SPEAKING
+        && m_hasPartial
+        && now - m_lastVoiced >= m_config.trailingSilence
+        && now - m_partialChanged >= m_config.stablePartial;
+}
+
+void Endpointer::set_forced() {
+    m_phase = Phase::ENDING;
+    m_forced = true;
+}
+
+EndpointingStats Endpointer::get_stats() const {
+    EndpointingStats stats;
+    stats.finals = m_finals;
+    stats.forcedFinals = m_forcedFinals;
+    if (m_latenciesUs.empty()) {
+        return stats;
+    }
+
+    std::vector<uint32_t> sorted(m_latenciesUs.size());
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        sorted[i] = m_latenciesUs.at(i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    stats.p50Ms = sorted[sorted.size() / 2] / 1000.0;
+    stats.p90Ms = sorted[std::min(sorted.size() - 1, sorted.size() * 9 / 10)] / 1000.0;
+    stats.maxMs = sorted.back() / 1000.0;
+    return stats;
+}
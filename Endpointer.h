@@ -0,0 +1,85 @@
+/**
+* @file Endpointer.h
+* @author zah
+* @brief Header for Endpointer: client-side end-of-utterance detection and capture-to-final latency
+* @version 0.1
+* @date 2024-03-15
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef ENDPOINTER_H
+#define ENDPOINTER_H
+
+#include "AudioPool.h"
+
+#include <chrono>
+#include <cstdint>
+
+/// @brief Client-side endpointing: ends utterances on local silence once the partial transcript has settled
+///
+/// The server only sends a final after its own silence threshold. The client hears the silence as soon as it
+/// captures it, and a partial that stopped changing means the server has caught up with the speech, so the
+/// utterance can be ended with force_end_utterance instead of waiting.
+struct EndpointingConfig {
+    std::chrono::milliseconds trailingSilence{ 0 }; ///< Silence after the last speech before forcing the end of the utterance, 0 leaves endpointing to the server
+    std::chrono::milliseconds stablePartial{ 300 }; ///< Time the partial transcript must have stayed unchanged before forcing
+    std::chrono::milliseconds serverSilenceThreshold{ 0 }; ///< Sent as end_utterance_silence_threshold when a session opens, 0 keeps the server's default
+    double energyThreshold{ 300.0 }; ///< RMS level (PCM16) above which a chunk counts as speech, 0 disables latency tracking too
+
+    /// @brief Settings for an aggressiveness from 0 (waits longest, fewest cut-off utterances) to 1 (ends soonest)
+    ///
+    /// The server threshold stays above the client's trailing silence, as a backstop for partials that keep changing.
+    static EndpointingConfig with_aggressiveness(double aggressiveness);
+};
+
+/// @brief End of speech (last voiced chunk captured) to final received, over the recent utterances of a channel
+struct EndpointingStats {
+    uint64_t finals{ 0 }; ///< Finals that closed an utterance with speech
+    uint64_t forcedFinals{ 0 }; ///< Of those, finals requested with force_end_utterance
+    double p50Ms{ 0.0 }; ///< Median capture-to-final latency
+    double p90Ms{ 0.0 }; ///< 90th percentile
+    double maxMs{ 0.0 }; ///< Slowest final
+};
+
+/// @brief Endpointing state of one channel session
+///
+/// Not thread-safe: RealTimeTranscriber only touches it under its audio queue mutex. Nothing allocates after configure.
+class Endpointer {
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    void configure(const EndpointingConfig& config); ///< Applies settings and forgets the current utterance and the latency history
+
+    void on_audio(bool voiced, time_point captured); ///< Tracks speech in a captured chunk
+    void on_partial(bool changed, time_point received); ///< Tracks a non-empty partial transcript, changed if its text differs from the previous one
+    void on_final(bool has_text, time_point received); ///< Closes the utterance and records its latency if it had speech
+    void on_reconnect(); ///< A new server session won't answer a force sent to the old one
+
+    bool should_end(time_point now) const; ///< True if the utterance should be force-ended now
+    void set_forced(); ///< The force_end_utterance request is queued, don't send another one for this utterance
+
+    EndpointingStats get_stats() const; ///< Latency percentiles over the recent finals
+
+private:
+    /// @brief Where the channel is in an utterance
+    enum class Phase {
+        IDLE = 0,     ///< No speech since the last final
+        SPEAKING = 1, ///< Speech heard, no final yet
+        ENDING = 2,   ///< force_end_utterance sent, waiting for the final
+    };
+
+    static const std::size_t s_historySize = 256; ///< Recent latencies kept for percentiles
+
+    EndpointingConfig m_config; ///< Current settings
+    Phase m_phase{ Phase::IDLE }; ///< Utterance state
+    time_point m_lastVoiced; ///< Capture time of the last chunk with speech
+    time_point m_partialChanged; ///< Arrival of the last partial whose text changed
+    bool m_hasPartial{ false }; ///< A non-empty partial arrived in this utterance
+    bool m_forced{ false }; ///< The utterance was force-ended
+    uint64_t m_finals{ 0 }; ///< Finals with speech
+    uint64_t m_forcedFinals{ 0 }; ///< Forced finals with speech
+    FixedRing<uint32_t> m_latenciesUs; ///< Recent capture-to-final latencies, in microseconds
+};
+
+#endif // ENDPOINTER_H
@@ -0,0 +1,387 @@
+/**
+* @file LoadTest.cpp
+* @author zah
+* @brief Ramps concurrent transcription sessions against the local stand-in server to find the per-node scaling knee
+* @version 0.1
+* @date 2024-03-29
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: LoadTest <cert.pem> <key.pem> [--sessions 1,2,4,8,16,32,64] [--seconds 10] [--audio speech.wav] [--port 9446] [--knee-factor 2] [--out load.json]
+* Each step runs N RealTimeTranscriber sessions at once, each with its own connection and threads, pushing 200 ms
+* chunks of 16 kHz mono PCM16 at real-time pace (synthetic, or a WAV/raw file looped with a different offset per
+* session), staggered over the chunk period like independent callers. The stand-in server answers every audio frame
+* with a partial, so each chunk is timed from its capture (push) to its partial. Per step: process CPU and RSS per
+* session, threads, send-queue depth (chunks queued in the transcribers and bytes buffered in their connections) and
+* capture-to-partial percentiles. The knee is the first step whose p90 exceeds knee-factor times the p90 of the first
+* step, or that loses chunks (dropped by the transcribers or never answered). Client and server share the process, so
+* CPU and RSS cover both ends of every session.
+*/
+
+#include "RealTimeTranscriber.h"
+#include "StandInServer.h"
+#include "ToolSupport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <sstream>
+
+using namespace ChatBot;
+
+namespace {
+    /// @brief Capture times of a session's chunks still waiting for their partial, and the latencies of the others
+    struct SessionProbe {
+        std::mutex mutex;
+        std::deque<std::chrono::steady_clock::time_point> pending;
+        std::vector<int64_t> latenciesUs;
+    };
+
+    /// @brief One session of a step: the transcriber, its probe and where it reads the audio
+    struct LoadSession {
+        std::unique_ptr<RealTimeTranscriber> transcriber;
+        std::unique_ptr<SessionProbe> probe;
+        std::size_t offset{ 0 }; ///< Next chunk of the audio to push
+    };
+
+    /// @brief Reads a field of /proc/self/status ("VmRSS", "Threads"), 0 where it isn't available
+    long proc_status(const std::string& key) {
+        std::ifstream status("/proc/self/status");
+        for (std::string line; std::getline(status, line);) {
+            if (line.compare(0, key.size() + 1, key + ":") == 0) {
+                return std::atol(line.c_str() + key.size() + 1);
+            }
+        }
+        return 0;
+    }
+
+    /// @brief Loads 16 kHz mono PCM16 audio: the data chunk of a WAV file in that format, or a raw file as is
+    bool load_audio(const std::string& path, std::vector<char>& pcm) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Could not open " << path << std::endl;
+            return false;
+        }
+        pcm.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (pcm.size() < 12 || std::memcmp(pcm.data(), "RIFF", 4) != 0) {
+            return !pcm.empty();
+        }
+        if (std::memcmp(pcm.data() + 8, "WAVE", 4) != 0) {
+            std::cerr << path << " is a RIFF file but not WAVE" << std::endl;
+            return false;
+        }
+
+        // Sessions stream at 16 kHz mono PCM16, other WAV formats would be sent as if they were
+        bool formatChecked = false;
+        std::size_t pos = 12;
+        while (pos + 8 <= pcm.size()) {
+            uint32_t bytes = 0;
+            std::memcpy(&bytes, pcm.data() + pos + 4, sizeof(bytes));
+            if (std::memcmp(pcm.data() + pos, "fmt ", 4) == 0) {
+                uint16_t formatTag = 0, channels = 0, bitsPerSample = 0;
+                uint32_t sampleRate = 0;
+                if (bytes < 16 || pos + 8 + 16 > pcm.size()) {
+                    std::cerr << path << " has a truncated fmt chunk" << std::endl;
+                    return false;
+                }
+                std::memcpy(&formatTag, pcm.data() + pos + 8, sizeof(formatTag));
+                std::memcpy(&channels, pcm.data() + pos + 10, sizeof(channels));
+                std::memcpy(&sampleRate, pcm.data() + pos + 12, sizeof(sampleRate));
+                std::memcpy(&bitsPerSample, pcm.data() + pos + 22, sizeof(bitsPerSample));
+                if (formatTag != 1 || channels != 1 || sampleRate != 16000 || bitsPerSample != 16) {
+                    std::cerr << path << " is format " << formatTag << ", " << channels << " channels, " << sampleRate << " Hz, "
+                              << bitsPerSample << " bits; LoadTest needs PCM (1), 1 channel, 16000 Hz, 16 bits" << std::endl;
+                    return false;
+                }
+                formatChecked = true;
+            }
+            else if (std::memcmp(pcm.data() + pos, "data", 4) == 0) {
+                if (!formatChecked) {
+                    std::cerr << path << " has no fmt chunk before its data" << std::endl;
+                    return false;
+                }
+                pcm.erase(pcm.begin() + pos + 8 + std::min<std::size_t>(bytes, pcm.size() - pos - 8), pcm.end());
+                pcm.erase(pcm.begin(), pcm.begin() + pos + 8);
+                return !pcm.empty();
+            }
+            pos += 8 + static_cast<std::size_t>(bytes) + (bytes & 1);
+        }
+        std::cerr << path << " has no data chunk" << std::endl;
+        return false;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::steady_clock;
+    if (argc < 3) {
+        std::cerr << "Usage: LoadTest <cert.pem> <key.pem> [--sessions 1,2,4,8,16,32,64] [--seconds 10] [--audio speech.wav] [--port 9446] [--knee-factor 2] [--out load.json]" << std::endl;
+        return 1;
+    }
+
+    const int SAMPLE_RATE = 16000;
+    const int CHUNK_MS = 200; // RealTimeTranscriber's default chunk
+    const int FRAMES_PER_CHUNK = SAMPLE_RATE * CHUNK_MS / 1000;
+    const std::size_t CHUNK_BYTES = FRAMES_PER_CHUNK * sizeof(int16_t);
+    const double KNEE_FLOOR_MS = 5.0; // A sub-millisecond first step would otherwise call jitter a knee
+    const int seconds = std::stoi(arg_value(argc, argv, "--seconds", "10"));
+    const unsigned short port = static_cast<unsigned short>(std::stoi(arg_value(argc, argv, "--port", "9446")));
+    const double kneeFactor = std::stod(arg_value(argc, argv, "--knee-factor", "2"));
+    const std::string audioPath = arg_value(argc, argv, "--audio", "");
+    const std::string outPath = arg_value(argc, argv, "--out", "");
+
+    std::vector<int> steps;
+    std::stringstream counts(arg_value(argc, argv, "--sessions", "1,2,4,8,16,32,64"));
+    for (std::string count; std::getline(counts, count, ',');) {
+        steps.push_back(std::max(1, std::stoi(count)));
+    }
+
+    // Synthetic audio alternates a second of tone with a second of low noise, a file is looped
+    std::vector<char> audio;
+    if (!audioPath.empty()) {
+        if (!load_audio(audioPath, audio)) {
+            return 1;
+        }
+    }
+    else {
+        audio.resize(2 * SAMPLE_RATE * sizeof(int16_t));
+        auto* samples = reinterpret_cast<int16_t*>(audio.data());
+        for (int i = 0; i < 2 * SAMPLE_RATE; ++i) {
+            samples[i] = i < SAMPLE_RATE
+                ? static_cast<int16_t>(4000 * std::sin(2 * 3.14159265358979 * 440 * i / SAMPLE_RATE))
+                : static_cast<int16_t>((i * 7919) % 61 - 30);
+        }
+    }
+    const std::size_t audioChunks = std::max<std::size_t>(1, audio.size() / CHUNK_BYTES);
+    audio.resize(audioChunks * CHUNK_BYTES); // Whole chunks, a short file is padded with silence
+
+    StandInServer server(port, argv[1], argv[2]);
+    if (!server.start()) {
+        return 1;
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+    // Sessions add to what the process holds with the server up and nothing connected
+    const long baselineRssKb = proc_status("VmRSS");
+    const long baselineThreads = proc_status("Threads");
+
+    nlohmann::json results = nlohmann::json::array();
+    double firstP90Ms = -1.0;
+    nlohmann::json knee;
+    std::vector<char> chunk(CHUNK_BYTES);
+    for (int sessionCount : steps) {
+        std::vector<LoadSession> sessions(sessionCount);
+        for (int s = 0; s < sessionCount; ++s) {
+            LoadSession& session = sessions[s];
+            session.probe = std::make_unique<SessionProbe>();
+            session.probe->latenciesUs.reserve(static_cast<std::size_t>(seconds) * 1000 / CHUNK_MS);
+            session.offset = (static_cast<std::size_t>(s) * 7) % audioChunks;
+            session.transcriber = std::make_unique<RealTimeTranscriber>(SAMPLE_RATE, 1, paInt16, std::chrono::milliseconds(CHUNK_MS));
+            session.transcriber->set_endpoint(server.uri());
+            session.transcriber->set_audio_source(AudioSource::EXTERNAL);
+            SessionProbe* probe = session.probe.get();
+            session.transcriber->set_transcript_handler([probe](int, const TranscriptDelta& delta) {
+                if (delta.isFinal) {
+                    return;
+                }
+                const clock::time_point now = clock::now();
+                std::lock_guard<std::mutex> lock(probe->mutex);
+                if (!probe->pending.empty()) {
+                    probe->latenciesUs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - probe->pending.front()).count());
+                    probe->pending.pop_front();
+                }
+            });
+            session.transcriber->start_transcription();
+        }
+
+        clock::time_point deadline = clock::now() + std::chrono::seconds(30);
+        int connected = 0;
+        while (clock::now() < deadline) {
+            connected = 0;
+            for (LoadSession& session : sessions) {
+                connected += session.transcriber->is_session_open(0) ? 1 : 0;
+            }
+            if (connected == sessionCount) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (connected < sessionCount) {
+            std::cerr << sessionCount << " sessions: only " << connected << " connected, stopping the ramp" << std::endl;
+            for (LoadSession& session : sessions) {
+                session.transcriber->stop_transcription();
+            }
+            break;
+        }
+
+        // Sessions push in turn, spread evenly over the chunk period
+        const clock::duration slot = std::chrono::milliseconds(CHUNK_MS) / sessionCount;
+        const int rounds = seconds * 1000 / CHUNK_MS;
+        uint64_t pushed = 0, dropped = 0, queueSamples = 0, bufferedSamples = 0, bufferedTimeouts = 0;
+        double queueChunksSum = 0, bufferedBytesSum = 0;
+        std::size_t queueChunksMax = 0, bufferedBytesMax = 0;
+
+        // Send queues are sampled every 50 ms on a thread of their own: buffered bytes are read on each session's
+        // WebSocket thread, which must not hold up the pushes. Every session is asked first, then the answers are
+        // collected against one deadline, so a sweep takes at most 100 ms however many sessions there are.
+        std::atomic<bool> sampling{ true };
+        std::thread sampler([&] {
+            std::vector<std::future<std::size_t>> buffered(sessions.size());
+            clock::time_point nextSample = clock::now();
+            while (sampling.load()) {
+                for (std::size_t i = 0; i < sessions.size(); ++i) {
+                    buffered[i] = sessions[i].transcriber->request_buffered_bytes(0);
+                }
+                for (LoadSession& sampled : sessions) {
+                    const std::size_t queued = sampled.transcriber->get_queue_depth();
+                    queueChunksSum += queued;
+                    queueChunksMax = std::max(queueChunksMax, queued);
+                    queueSamples++;
+                }
+                const clock::time_point answerDeadline = clock::now() + std::chrono::milliseconds(100);
+                for (std::future<std::size_t>& answer : buffered) {
+                    std::size_t bytes = 0;
+                    try {
+                        if (answer.wait_until(answerDeadline) != std::future_status::ready) {
+                            bufferedTimeouts++; // Not a sample: a busy WebSocket thread isn't an empty buffer
+                            continue;
+                        }
+                        bytes = answer.get();
+                    }
+                    catch (const std::future_error&) {
+                        bufferedTimeouts++;
+                        continue;
+                    }
+                    bufferedBytesSum += bytes;
+                    bufferedBytesMax = std::max(bufferedBytesMax, bytes);
+                    bufferedSamples++;
+                }
+                nextSample += std::chrono::milliseconds(50);
+                std::this_thread::sleep_until(nextSample);
+            }
+        });
+
+        const std::clock_t cpuStart = std::clock();
+        const clock::time_point start = clock::now();
+        clock::time_point next = start;
+        for (int round = 0; round < rounds; ++round) {
+            for (LoadSession& session : sessions) {
+                std::this_thread::sleep_until(next);
+                next += slot;
+                std::memcpy(chunk.data(), audio.data() + session.offset * CHUNK_BYTES, CHUNK_BYTES);
+                session.offset = (session.offset + 1) % audioChunks;
+
+                std::lock_guard<std::mutex> lock(session.probe->mutex);
+                session.probe->pending.push_back(clock::now());
+                if (session.transcriber->push_audio(0, chunk)) {
+                    pushed++;
+                }
+                else {
+                    session.probe->pending.pop_back();
+                    dropped++;
+                }
+            }
+        }
+        const double wallSeconds = std::chrono::duration<double>(clock::now() - start).count();
+        const double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        sampling.store(false);
+        sampler.join(); // Before the thread count, which is about the sessions
+        const long rssKb = proc_status("VmRSS");
+        const long threads = proc_status("Threads");
+
+        // Partials still on their way get a moment, those that don't come are counted as unanswered
+        deadline = clock::now() + std::chrono::seconds(5);
+        std::size_t unanswered = 0;
+        while (clock::now() < deadline) {
+            unanswered = 0;
+            for (LoadSession& session : sessions) {
+                std::lock_guard<std::mutex> lock(session.probe->mutex);
+                unanswered += session.probe->pending.size();
+            }
+            if (unanswered == 0) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        for (LoadSession& session : sessions) {
+            session.transcriber->stop_transcription();
+        }
+
+        std::vector<int64_t> sorted;
+        for (LoadSession& session : sessions) {
+            std::lock_guard<std::mutex> lock(session.probe->mutex);
+            sorted.insert(sorted.end(), session.probe->latenciesUs.begin(), session.probe->latenciesUs.end());
+        }
+        std::sort(sorted.begin(), sorted.end());
+        const double p90Ms = percentile(sorted, 0.90) / 1000.0;
+        if (firstP90Ms < 0) {
+            firstP90Ms = p90Ms;
+        }
+        const bool degraded = dropped > 0 || unanswered > 0 || (p90Ms > kneeFactor * firstP90Ms && p90Ms - firstP90Ms >= KNEE_FLOOR_MS);
+        if (degraded && knee.is_null()) {
+            knee = sessionCount;
+        }
+
+        const double cpuPercent = wallSeconds > 0 ? 100.0 * cpuSeconds / wallSeconds : 0.0;
+        results.push_back({
+            {"sessions", sessionCount},
+            {"chunks", pushed},
+            {"dropped", dropped},
+            {"unanswered", unanswered},
+            {"cpu_percent", cpuPercent},
+            {"cpu_percent_per_session", cpuPercent / sessionCount},
+            {"rss_mb", rssKb / 1024.0},
+            {"rss_mb_per_session", (rssKb - baselineRssKb) / 1024.0 / sessionCount},
+            {"threads", threads},
+            {"threads_per_session", static_cast<double>(threads - baselineThreads) / sessionCount},
+            {"send_queue", {
+                {"mean_chunks", queueSamples > 0 ? queueChunksSum / queueSamples : 0.0},
+                {"max_chunks", queueChunksMax},
+                {"mean_buffered_kb", bufferedSamples > 0 ? bufferedBytesSum / bufferedSamples / 1024.0 : 0.0},
+                {"max_buffered_kb", bufferedBytesMax / 1024.0},
+                {"buffered_timeouts", bufferedTimeouts},
+            }},
+            {"capture_to_partial_ms", {
+                {"p50", percentile(sorted, 0.50) / 1000.0},
+                {"p90", p90Ms},
+                {"p99", percentile(sorted, 0.99) / 1000.0},
+                {"max", sorted.empty() ? 0.0 : sorted.back() / 1000.0},
+            }},
+            {"degraded", degraded},
+        });
+        std::cerr << sessionCount << " sessions: " << cpuPercent / sessionCount << "% CPU and " << (rssKb - baselineRssKb) / 1024.0 / sessionCount
+                  << " MB per session, " << threads << " threads, p50 " << percentile(sorted, 0.50) / 1000.0 << " ms, p90 " << p90Ms
+                  << " ms, " << dropped << " dropped" << (degraded ? " (degraded)" : "") << std::endl;
+    }
+
+    std::cout.rdbuf(console);
+    server.stop();
+
+    nlohmann::json report = {
+        {"schema", 1},
+        {"chunk_ms", CHUNK_MS},
+        {"seconds", seconds},
+        {"audio", audioPath.empty() ? "synthetic" : audioPath},
+        {"hardware_threads", std::thread::hardware_concurrency()},
+        {"baseline", {
+            {"rss_mb", baselineRssKb / 1024.0},
+            {"threads", baselineThreads},
+        }},
+        {"knee_factor", kneeFactor},
+        {"knee_sessions", knee},
+        {"results", results},
+    };
+    if (outPath.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    }
+    else {
+        std::ofstream(outPath) << report.dump(2) << std::endl;
+    }
+    return 0;
+}
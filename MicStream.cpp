@@ -2,37 +2,33 @@
 
 
 
-MicrophoneStream::MicrophoneStream(int sampleRate)
-    : m_stream(nullptr)
+MicrophoneStream::MicrophoneStream(int sampleRate, int channels, const std::string& device)
+    : m_audio(AudioRuntime::acquire())
     , m_sampleRate(sampleRate)
+    , m_channels(channels)
     , m_chunkSize(sampleRate * 0.1)
     , m_isRunning(false)
 {
-    PaError err;
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-        return;
-    }
-
-    m_streamParameters.device = Pa_GetDefaultInputDevice(); // Use the default input audio device
-    if (m_streamParameters.device == paNoDevice) {
-        std::cerr << "No default input device found!" << std::endl;
+    InputStreamConfig config;
+    config.device = m_audio->findInputDevice(device); // Default input device unless one is named
+    if (config.device == paNoDevice) {
+        std::cerr << "No input device matches '" << device << "'" << std::endl;
         return;
     }
+    config.channels = m_channels; // Interleaved, split with getNextChannelChunks
+    config.format = paInt16; // 16-bit PCM
+    config.sampleRate = m_sampleRate;
+    config.framesPerBuffer = m_chunkSize;
+    config.blocking = true; // Read with Pa_ReadStream
 
-    m_streamParameters.channelCount = 1; // Single channel
-    m_streamParameters.sampleFormat = paInt16; // 16-bit PCM
-    m_streamParameters.suggestedLatency = Pa_GetDeviceInfo(m_streamParameters.device)->defaultLowInputLatency;
-    m_streamParameters.hostApiSpecificStreamInfo = nullptr;
-
-    err = Pa_OpenStream(&m_stream, &m_streamParameters, nullptr, m_sampleRate, m_chunkSize, paClipOff, nullptr, nullptr);
-    if (err != paNoError) {
+    PaError err;
+    m_stream = m_audio->openInputStream(config, nullptr, nullptr, err);
+    if (!m_stream) {
         std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
         return;
     }
 
-    err = Pa_StartStream(m_stream);
+    err = m_stream->start();
     if (err != paNoError) {
         std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
         return;
@@ -46,20 +42,31 @@ MicrophoneStream::~MicrophoneStream() {
 }
 
 std::vector<int16_t> MicrophoneStream::getNextChunk() {
-    std::vector<int16_t> audioData(m_chunkSize);
+    std::vector<int16_t> audioData(m_chunkSize * m_channels);
     if (m_isRunning) {
-        Pa_ReadStream(m_stream, audioData.data(), m_chunkSize);
+        Pa_ReadStream(m_stream->get(), audioData.data(), m_chunkSize);
     }
     return audioData;
 }
 
-void MicrophoneStream::close() {
-    if (m_isRunning) {
-        Pa_StopStream(m_stream);
-        Pa_CloseStream(m_stream);
-        Pa_Terminate();
-        m_isRunning = false;
+std::vector<std::vector<int16_t>> MicrophoneStream::getNextChannelChunks() {
+    std::vector<int16_t> interleaved = getNextChunk();
+    std::vector<std::vector<int16_t>> channelData(m_channels, std::vector<int16_t>(m_chunkSize));
+    std::vector<int16_t*> targets;
+    for (auto& channel : channelData) {
+        targets.push_back(channel.data());
     }
+    deinterleave(interleaved.data(), m_chunkSize, m_channels, targets.data());
+    return channelData;
+}
+
+int MicrophoneStream::getChannels() const {
+    return m_channels;
+}
+
+void MicrophoneStream::close() {
+    m_isRunning = false;
+    m_stream.reset(); // Stops it and hands it back to the runtime for the next MicrophoneStream; the runtime reference goes with the object
 }
 
 bool MicrophoneStream::isOpen() const {
@@ -2,8 +2,12 @@
 #define MICROPHONE_STREAM_H
 
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 #include <portaudio.h>
+#include "AudioRuntime.h"
+#include "Deinterleave.h"
 #include <pybind11/pybind11.h>
 
 namespace py = pybind11;
@@ -12,10 +16,13 @@ namespace py = pybind11;
 
 class MicrophoneStream {
 public:
-    MicrophoneStream(int sampleRate);
+    MicrophoneStream(int sampleRate, int channels = 1, const std::string& device = "");
     ~MicrophoneStream();
 
     std::vector<int16_t> getNextChunk();
+    std::vector<std::vector<int16_t>> getNextChannelChunks();
+
+    int getChannels() const;
 
     bool isOpen() const;
 
@@ -41,9 +48,10 @@ public:
     Iterator end();
 
 private:
-    PaStream* m_stream;
-    PaStreamParameters m_streamParameters;
+    std::shared_ptr<AudioRuntime> m_audio;
+    std::unique_ptr<InputStreamLease> m_stream;
     int m_sampleRate;
+    int m_channels;
     int m_chunkSize;
     bool m_isRunning;
 };
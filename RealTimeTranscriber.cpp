@@ -10,13 +10,30 @@
  */
 #include "RealTimeTranscriber.h"
 
+#include <algorithm>
+#include <cstring>
+
 
 using namespace ChatBot;
 
+namespace {
+    const char* const s_serviceEndpoint = "wss://api.assemblyai.com/v2/realtime/ws"; ///< AssemblyAI real-time endpoint
+    const std::size_t s_queueChunksPerChannel = 64; ///< Send queue depth per channel in chunks, 64 times the configured chunk (12.8 s at the default 200 ms)
+    const int s_resumeBufferSeconds = 10; ///< Audio kept while a resumed session reconnects
+
+    // Handlers of a superseded connection (e.g. the close of a suspended session) must not touch its successor
+    bool same_connection(const connection_hdl& a, const connection_hdl& b) {
+        return !a.owner_before(b) && !b.owner_before(a);
+    }
+} // namespace
+
 
-RealTimeTranscriber::RealTimeTranscriber(int sample_rate)
-    : m_sampleRate(sample_rate)
-    , m_framesPerBuffer(static_cast<int>(sample_rate * 0.2))
+RealTimeTranscriber::RealTimeTranscriber(int sample_rate, int channels, PaSampleFormat format, std::chrono::milliseconds chunk)
+    : m_endpoint(s_serviceEndpoint)
+    , m_sampleRate(sample_rate)
+    , m_framesPerBuffer(static_cast<int>(static_cast<int64_t>(sample_rate) * chunk.count() / 1000))
+    , m_format(format)
+    , m_channels(channels)
 {
     // Set up WebSocket++ loggers
     m_wsClient.clear_access_channels(websocketpp::log::alevel::all);
@@ -25,24 +42,22 @@ RealTimeTranscriber::RealTimeTranscriber(int sample_rate)
     // Initialize the Asio transport policy
     m_wsClient.init_asio();
 
-    // Register our message handler
-    m_wsClient.set_message_handler(bind(&RealTimeTranscriber::on_message, this, ::_1, ::_2));
-    m_wsClient.set_open_handler(bind(&RealTimeTranscriber::on_open, this, ::_1));
-    m_wsClient.set_close_handler(bind(&RealTimeTranscriber::on_close, this, ::_1));
+    // Message, open and close handlers are registered per connection so they know their channel
     m_wsClient.set_tls_init_handler(bind(&RealTimeTranscriber::on_tls_init, this, ::_1));
+    m_wsClient.set_tcp_pre_init_handler(bind(&RealTimeTranscriber::on_tcp_pre_init, this, ::_1));
 
-    // Initialize PortAudio
-    m_audioErr = Pa_Initialize();
-    if (m_audioErr != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_audioErr) << std::endl;
-        return;
+    // Share the process-wide PortAudio runtime instead of initializing PortAudio per transcriber
+    m_audio = AudioRuntime::acquire();
+    if (!m_audio->isInitialized()) {
+        std::cerr << "PortAudio is not available, only EXTERNAL audio can be transcribed" << std::endl;
     }
 
-    // Preallocate 
-    m_audioDataBuffer.resize(m_framesPerBuffer * m_channels * sizeof(int16_t));
-    m_audioJSONBuffer["audio_data"] = "";
-
-    
+    // One session per channel, fed by a capture pipeline built for this format, channel count and chunk size
+    m_sessions.resize(m_channels);
+    m_capture = make_capture_pipeline(m_format, m_channels, m_sampleRate, chunk);
+    m_frameBuffer.reserve(audio_frame_size(m_framesPerBuffer * sizeof(int16_t)));
+    m_messageType.reserve(32);
+    m_messageText.reserve(1024);
 }
 
 RealTimeTranscriber::~RealTimeTranscriber() {
@@ -50,12 +65,8 @@ RealTimeTranscriber::~RealTimeTranscriber() {
         stop_transcription(); // Stop the transcription if it's running
     }
 
-    // Terminate PortAudio
-    if (m_audioStream) { // Check if the stream was created
-        Pa_CloseStream(m_audioStream); // Close the stream if it was left open
-        m_audioStream = nullptr; // Reset the pointer to indicate it's closed
-    }
-    Pa_Terminate(); // Terminate PortAudio
+    // Hand the stream back to the runtime, the next transcriber with the same settings reuses it
+    m_audioStream.reset();
 }
 
 void RealTimeTranscriber::start_transcription() {
@@ -66,50 +77,42 @@ void RealTimeTranscriber::start_transcription() {
         return;
     }
 
-    // Establish a new WebSocket connection
-    std::string uri = "wss://api.assemblyai.com/v2/realtime/ws?sample_rate=" + std::to_string(m_sampleRate);
-    m_con = m_wsClient.get_connection(uri, m_wsError);
-    if (m_wsError) {
-        std::cerr << "Could not create connection because: " << m_wsError.message() << std::endl;
-        return;
-    }
+    // Everything the audio path needs is allocated here, before the first chunk arrives
+    prepare_buffers();
 
-    m_con->append_header("Authorization", m_aaiAPItoken);
-    m_wsHandle = m_con->get_handle();
-    m_wsClient.connect(m_con);
+    // A previous stop left the io_service stopped, run() would return at once and the connections would never open
+    m_wsClient.reset();
 
-    m_isConnected.store(true); // This allows the callback loop to start
+    // Create a WebSocket connection for every channel, they all share the client's io_service.
+    // Nothing is queued on the io_service until every step that can fail has succeeded, a queued
+    // connect would otherwise fire on the next start's run() next to that start's own connections.
+    for (int channel = 0; channel < m_channels; ++channel) {
+        if (!create_session(channel)) {
+            discard_sessions();
+            return;
+        }
+    }
 
-    // Open an audio I/O stream.
-    m_audioErr = Pa_OpenDefaultStream(
-        &m_audioStream,							    // Stream pointer
-        m_channels,                                 // Input m_channels
-        0,                                          // Output channels
-        m_format,                                   // Sample format
-        m_sampleRate,		                        // Sample rate
-        m_framesPerBuffer,                          // Frames per buffer
-        &RealTimeTranscriber::pa_callback,          // Callback function
-        this										// Callback data (this class)
-    );
+    m_stopFlag.store(false);
+    m_isConnected.store(true); // This allows the callback loop to start
 
-    if (m_audioErr != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_audioErr) << std::endl;
-        m_wsClient.stop();
+    // Open an audio I/O stream, unless the caller pushes audio itself.
+    if (m_audioSource == AudioSource::MICROPHONE && !open_audio_stream()) {
+        m_isConnected.store(false);
+        m_stopFlag.store(true);
+        discard_sessions();
         return;
     }
 
-    // Start the audio stream
-    m_audioErr = Pa_StartStream(m_audioStream);
-    if (m_audioErr != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_audioErr) << std::endl;
-        m_wsClient.stop();
-        return;
+    for (ChannelSession& session : m_sessions) {
+        m_wsClient.connect(session.con);
     }
 
     // Start the ASIO io_service run loop in a new thread if not already running
     if (m_wsThread.joinable()) {
         m_wsThread.join(); // Make sure the previous thread has finished
     }
+    m_wsClient.start_perpetual(); // Keep the io_service running while every session is suspended
     m_wsThread = std::thread([this] { m_wsClient.run(); });
 
     // Start the thread for sending audio data
@@ -120,6 +123,117 @@ void RealTimeTranscriber::start_transcription() {
 
 }
 
+bool RealTimeTranscriber::open_session(int channel) {
+    client::connection_ptr con = create_session(channel);
+    if (!con) {
+        return false;
+    }
+    m_wsClient.connect(con);
+    return true;
+}
+
+client::connection_ptr RealTimeTranscriber::create_session(int channel) {
+    websocketpp::lib::error_code ec;
+    std::string uri = m_endpoint + "?sample_rate=" + std::to_string(m_sampleRate);
+    client::connection_ptr con = m_wsClient.get_connection(uri, ec);
+    if (ec) {
+        std::cerr << "Could not create connection for channel " << channel << " because: " << ec.message() << std::endl;
+        return nullptr;
+    }
+
+    con->append_header("Authorization", m_aaiAPItoken);
+    if (m_endpoint != s_serviceEndpoint) {
+        con->append_header("X-Channel", std::to_string(channel)); // Lets stand-in servers tell channel sessions apart, the service doesn't need it
+    }
+    con->set_message_handler(bind(&RealTimeTranscriber::on_message, this, channel, ::_1, ::_2));
+    con->set_open_handler(bind(&RealTimeTranscriber::on_open, this, channel, ::_1));
+    con->set_close_handler(bind(&RealTimeTranscriber::on_close, this, channel, ::_1));
+    con->set_fail_handler(bind(&RealTimeTranscriber::on_fail, this, channel, ::_1));
+    {
+        // The capture thread reads the connection state when routing audio
+        std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+        m_sessions[channel].con = con;
+        m_sessions[channel].handle = con->get_handle();
+        m_sessions[channel].connection = ConnectionState::CONNECTING;
+    }
+    return con;
+}
+
+void RealTimeTranscriber::discard_sessions() {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    for (ChannelSession& session : m_sessions) {
+        session.con.reset();
+        session.handle.reset();
+        session.connection = ConnectionState::CLOSED;
+    }
+}
+
+void RealTimeTranscriber::prepare_buffers() {
+    const std::size_t chunkBytes = m_framesPerBuffer * sizeof(int16_t);
+
+    // Pre-roll holds the configured audio plus what arrives while a resumed session reconnects
+    std::size_t preRollChunks = 0;
+    if (m_idleSuspend.idleTimeout.count() > 0) {
+        const std::size_t chunkMs = std::max<std::size_t>(1, 1000 * m_framesPerBuffer / m_sampleRate);
+        preRollChunks = (m_idleSuspend.preRoll.count() + chunkMs - 1) / chunkMs + s_resumeBufferSeconds * 1000 / chunkMs;
+    }
+
+    // A flushed pre-roll lands in the queue, and the send thread holds one buffer while framing it
+    const std::size_t queueChunks = m_channels * (s_queueChunksPerChannel + preRollChunks);
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    m_audioQueue.reset(queueChunks);
+    m_audioPool.reset(queueChunks + m_channels * preRollChunks + 1, chunkBytes);
+
+    const auto now = std::chrono::steady_clock::now();
+    for (ChannelSession& session : m_sessions) {
+        session.lifecycle = Lifecycle::ACTIVE;
+        session.lastActivity = now;
+        session.preRoll.reset(preRollChunks);
+        session.preRollBytes = 0;
+        session.endpointer.configure(m_endpointing);
+        session.transcriptDiff.reset(); // A stop mid-utterance must not leave its text as the base of the next session's first partial
+    }
+}
+
+bool RealTimeTranscriber::open_audio_stream() {
+    if (!m_capture) {
+        std::cerr << "Unsupported capture sample format: " << m_format << std::endl;
+        return false;
+    }
+
+    PaDeviceIndex device = m_audio->findInputDevice(m_inputDevice);
+    if (device == paNoDevice) {
+        std::cerr << "No input device matches '" << m_inputDevice << "'" << std::endl;
+        return false;
+    }
+
+    // One stream with every channel interleaved in one buffer
+    InputStreamConfig config;
+    config.device = device;
+    config.channels = m_channels;
+    config.format = m_format;
+    config.sampleRate = m_sampleRate;
+    config.framesPerBuffer = m_framesPerBuffer;
+
+    // A restart keeps the stream of the previous start, unless the device went away or changed
+    if (!m_audioStream || !(m_audioStream->getConfig() == config)) {
+        m_audioStream.reset();
+        m_audioStream = m_audio->openInputStream(config, &RealTimeTranscriber::pa_callback, this, m_audioErr);
+        if (!m_audioStream) {
+            std::cerr << "PortAudio error: " << Pa_GetErrorText(m_audioErr) << std::endl;
+            return false;
+        }
+    }
+
+    // Start the audio stream
+    m_audioErr = m_audioStream->start();
+    if (m_audioErr != paNoError) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(m_audioErr) << std::endl;
+        return false;
+    }
+    return true;
+}
+
 void RealTimeTranscriber::stop_transcription() {
     {
         std::lock_guard<std::mutex> lock(m_startStopMutex);
@@ -132,9 +246,9 @@ void RealTimeTranscriber::stop_transcription() {
         m_stopFlag.store(true); // This stops the sending thread
     }
 
-    // Stop and close the PortAudio stream if it's running.
+    // Stop the PortAudio stream if it's running, it stays open for the next start.
     if (m_audioStream) {
-        m_audioErr = Pa_StopStream(m_audioStream);
+        m_audioErr = m_audioStream->stop();
         if (m_audioErr != paNoError) {
             std::cerr << "PortAudio error when stopping the stream: " << Pa_GetErrorText(m_audioErr) << std::endl;
         }
@@ -147,147 +261,570 @@ void RealTimeTranscriber::stop_transcription() {
         m_sendThread.join(); // Ensure the sending thread is finished before destruction
     }
 
-    // Close the WebSocket connection if it's open.
-    if (m_wsClient.get_con_from_hdl(m_wsHandle)->get_state() == websocketpp::session::state::open) {
-        m_wsClient.close(m_wsHandle, websocketpp::close::status::going_away, "Closing connection");
+    // Close the WebSocket connections that are open.
+    for (ChannelSession& session : m_sessions) {
+        if (session.con && session.con->get_state() == websocketpp::session::state::open) {
+            m_wsClient.close(session.handle, websocketpp::close::status::going_away, "Closing connection");
+        }
     }
 
     // Stop the WebSocket client's ASIO io_service to allow the thread to finish
+    m_wsClient.stop_perpetual();
     m_wsClient.stop();
     if (m_wsThread.joinable()) {
         m_wsThread.join();
     }
 
-    // Reset the connection handle and state
-    m_con.reset();
-    m_wsHandle.reset();
+    // Reset the connection handles and state
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    for (ChannelSession& session : m_sessions) {
+        session.con.reset();
+        session.handle.reset();
+    }
 }
 
-int RealTimeTranscriber::pa_callback(const void* inputBuffer, void* outputBuffer,
-    unsigned long framesPerBuffer,
-    const PaStreamCallbackTimeInfo* timeInfo,
-    PaStreamCallbackFlags statusFlags,
-    void* userData) {
+void RealTimeTranscriber::set_transcript_handler(transcript_handler handler) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_transcriptHandler = std::move(handler);
+}
+
+void RealTimeTranscriber::set_endpoint(const std::string& uri) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_endpoint = uri;
+}
+
+void RealTimeTranscriber::set_audio_source(AudioSource source) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_audioSource = source;
+}
+
+void RealTimeTranscriber::set_idle_suspend(const IdleSuspendConfig& config) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_idleSuspend = config;
+}
+
+void RealTimeTranscriber::set_transport_profile(const TransportProfile& profile) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_transport = profile;
+}
+
+void RealTimeTranscriber::set_input_device(const std::string& device) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_inputDevice = device;
+}
+
+void RealTimeTranscriber::set_endpointing(const EndpointingConfig& config) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_endpointing = config;
+}
+
+bool RealTimeTranscriber::enable_recording(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_recorder.reset(); // A log from a previous start is closed before its file is rewritten
+    m_recorder = std::make_unique<SessionRecorder>(path, m_sampleRate, m_channels, m_framesPerBuffer);
+    if (!m_recorder->isOpen()) {
+        m_recorder.reset();
+        return false;
+    }
+    return true;
+}
+
+bool RealTimeTranscriber::enable_transcript_channel(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_transcriptChannel = std::make_unique<TranscriptPublisher>(name);
+    if (!m_transcriptChannel->isOpen()) {
+        m_transcriptChannel.reset();
+        return false;
+    }
+    return true;
+}
+
+bool RealTimeTranscriber::push_audio(int channel, const std::vector<char>& audio_data) {
+    if (m_audioSource != AudioSource::EXTERNAL || !m_isConnected.load() || channel < 0 || channel >= m_channels) {
+        return false;
+    }
+    // Pooled buffers hold one capture chunk
+    if (audio_data.size() > m_framesPerBuffer * sizeof(int16_t)) {
+        std::cerr << "Audio chunk of " << audio_data.size() << " bytes is larger than " << m_framesPerBuffer * sizeof(int16_t) << std::endl;
+        return false;
+    }
+    m_inputTimestamp = std::chrono::high_resolution_clock::now();
+
+    // Same rules as the capture callback
+    return route_audio(channel, audio_data.data(), audio_data.size(), std::chrono::steady_clock::now()) == RouteResult::QUEUED;
+}
+
+bool RealTimeTranscriber::is_session_open(int channel) const {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    return m_isConnected.load() && m_sessions[channel].connection == ConnectionState::OPEN;
+}
+
+uint64_t RealTimeTranscriber::get_dropped_chunks() const {
+    return m_droppedChunks.load();
+}
+
+std::size_t RealTimeTranscriber::get_queue_depth() const {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    return m_audioQueue.size();
+}
+
+std::future<std::size_t> RealTimeTranscriber::request_buffered_bytes(int channel) {
+    client::connection_ptr con;
+    {
+        std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+        con = m_sessions[channel].con;
+    }
+    auto sampled = std::make_shared<std::promise<std::size_t>>();
+    std::future<std::size_t> result = sampled->get_future();
+    if (!con || !m_isConnected.load()) {
+        sampled->set_value(0);
+        return result;
+    }
+
+    // The WebSocket thread completes the writes and lowers the count, so the count is read there
+    boost::asio::post(m_wsClient.get_io_service(), [con, sampled] { sampled->set_value(con->get_buffered_amount()); });
+    return result;
+}
+
+std::optional<std::size_t> RealTimeTranscriber::get_buffered_bytes(int channel) {
+    std::future<std::size_t> result = request_buffered_bytes(channel);
+    if (result.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        return std::nullopt;
+    }
+    try {
+        return result.get();
+    }
+    catch (const std::future_error&) {
+        return std::nullopt; // The io_service was stopped and dropped the read
+    }
+}
+
+std::string RealTimeTranscriber::get_tls_session(int channel) const {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    return m_sessions[channel].tlsSession;
+}
+
+EndpointingStats RealTimeTranscriber::get_endpointing_stats(int channel) const {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    return m_sessions[channel].endpointer.get_stats();
+}
+
+int RealTimeTranscriber::pa_callback(const void* inputBuffer, unsigned long framesPerBuffer, std::chrono::steady_clock::time_point captured, void* userData) {
     auto* client = static_cast<RealTimeTranscriber*>(userData);
-    return client->on_audio_data(inputBuffer, framesPerBuffer);
+    return client->on_audio_data(inputBuffer, framesPerBuffer, captured);
 }
 
-int RealTimeTranscriber::on_audio_data(const void* inputBuffer, unsigned long framesPerBuffer) {
+int RealTimeTranscriber::on_audio_data(const void* inputBuffer, unsigned long framesPerBuffer, std::chrono::steady_clock::time_point captured) {
+    ALLOCATION_AUDIT_SCOPE();
+
     // Check if the transcription has been stopped and if so, return immediately.
     if (!m_isConnected.load()) {
         return paComplete; // Use paComplete to indicate the stream can be stopped.
     }
     m_inputTimestamp = std::chrono::high_resolution_clock::now();
 
-    // Before sending, check if the WebSocket connection is open and valid.
-    if (m_wsClient.get_con_from_hdl(m_wsHandle)->get_state() != websocketpp::session::state::open) {
+    // Split the interleaved frames into one PCM16 chunk per channel session.
+    const std::size_t chunkBytes = m_capture->split(inputBuffer, framesPerBuffer);
+
+    // Queue each channel, or keep it in the pre-roll while its session is suspended.
+    int closed = 0;
+    for (int channel = 0; channel < m_channels; ++channel) {
+        if (route_audio(channel, m_capture->channel_data(channel), chunkBytes, captured) == RouteResult::CLOSED) {
+            closed++;
+        }
+    }
+    if (closed == m_channels) {
         std::cerr << "WebSocket connection is not open." << std::endl;
-        return paComplete; // Use paComplete if the connection isn't open to indicate the stream should be stopped.
+        return paComplete; // Use paComplete if no connection is open to indicate the stream should be stopped.
     }
 
-    // Cast data passed through stream to our structure.
-    const auto* in = static_cast<const int16_t*>(inputBuffer);
-    m_audioDataBuffer.assign(reinterpret_cast<const char*>(in), reinterpret_cast<const char*>(in) + framesPerBuffer * m_channels * sizeof(int16_t)); // Copy the audio data into the buffer
-    enqueue_audio_data(m_audioDataBuffer);
-
     return paContinue;
 }
 
+RealTimeTranscriber::RouteResult RealTimeTranscriber::route_audio(int channel, const char* data, std::size_t size, std::chrono::steady_clock::time_point captured) {
+    ChannelSession& session = m_sessions[channel];
+    const bool autoSuspend = m_idleSuspend.idleTimeout.count() > 0;
+    const bool trackSpeech = m_endpointing.energyThreshold > 0;
+    const double energy = autoSuspend || trackSpeech ? mean_square(data, size) : 0.0;
+    const bool voiced = autoSuspend && energy >= m_idleSuspend.energyThreshold * m_idleSuspend.energyThreshold;
+    const bool speech = trackSpeech && energy >= m_endpointing.energyThreshold * m_endpointing.energyThreshold;
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    if (voiced) {
+        session.lastActivity = now;
+    }
+    session.endpointer.on_audio(speech, captured); // Latency counts from when the speech was captured, not from when the callback ran
+
+    if (session.lifecycle == Lifecycle::ACTIVE) {
+        // Before sending, check if the WebSocket connection is open.
+        if (session.connection == ConnectionState::CLOSED) {
+            return RouteResult::CLOSED;
+        }
+        if (session.connection != ConnectionState::OPEN || !queue_audio(channel, data, size)) {
+            return RouteResult::DROPPED;
+        }
+
+        // Silence after settled speech: end the utterance once the audio queued so far is sent
+        if (session.endpointer.should_end(now) && m_audioQueue.push_back(AudioChunk{ channel, nullptr, ChunkKind::END_UTTERANCE })) {
+            session.endpointer.set_forced();
+        }
+
+        // Idle for too long: end the server session once the audio queued so far is sent
+        if (autoSuspend && now - session.lastActivity >= m_idleSuspend.idleTimeout && m_audioQueue.push_back(AudioChunk{ channel, nullptr, ChunkKind::SUSPEND })) {
+            session.lifecycle = Lifecycle::SUSPENDED;
+        }
+    }
+    else {
+        // Suspended: keep only the pre-roll. Resuming: keep everything (up to 10 s) until the connection opens.
+        const std::size_t bytesPerSecond = m_sampleRate * sizeof(int16_t);
+        std::size_t limit = m_idleSuspend.preRoll.count() * bytesPerSecond / 1000;
+        if (session.lifecycle == Lifecycle::RESUMING) {
+            limit += s_resumeBufferSeconds * bytesPerSecond;
+        }
+
+        // A full pre-roll recycles its oldest buffer
+        AudioBuffer* buffer = nullptr;
+        if (session.preRoll.full() && !session.preRoll.empty()) {
+            buffer = session.preRoll.front();
+            session.preRoll.pop_front();
+            session.preRollBytes -= buffer->size;
+        }
+        else {
+            buffer = m_audioPool.acquire();
+        }
+        if (!buffer) {
+            m_droppedChunks++;
+            return RouteResult::DROPPED;
+        }
+        if (!session.preRoll.push_back(buffer)) {
+            m_audioPool.release(buffer); // No pre-roll configured
+            return RouteResult::DROPPED;
+        }
+        std::memcpy(buffer->bytes.data(), data, size);
+        buffer->size = size;
+        session.preRollBytes += size;
+        while (session.preRollBytes > limit && session.preRoll.size() > 1) {
+            session.preRollBytes -= session.preRoll.front()->size;
+            m_audioPool.release(session.preRoll.front());
+            session.preRoll.pop_front();
+        }
+
+        if (session.lifecycle == Lifecycle::SUSPENDED && voiced && m_audioQueue.push_back(AudioChunk{ channel, nullptr, ChunkKind::RESUME })) {
+            session.lifecycle = Lifecycle::RESUMING;
+        }
+    }
+    m_queueCond.notify_one();
+    return RouteResult::QUEUED;
+}
+
+double RealTimeTranscriber::mean_square(const char* data, std::size_t size) const {
+    const auto* samples = reinterpret_cast<const int16_t*>(data);
+    const std::size_t count = size / sizeof(int16_t);
+    int64_t energy = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        energy += int32_t(samples[i]) * samples[i];
+    }
+    // Compared against squared thresholds, so no square root
+    return count > 0 ? static_cast<double>(energy) / count : 0.0;
+}
+
+bool RealTimeTranscriber::queue_audio(int channel, const char* data, std::size_t size) {
+    // Drop rather than grow: the queue and the pool are sized for seconds of backlog
+    AudioBuffer* buffer = m_audioQueue.full() ? nullptr : m_audioPool.acquire();
+    if (!buffer) {
+        m_droppedChunks++;
+        return false;
+    }
+    std::memcpy(buffer->bytes.data(), data, size);
+    buffer->size = size;
+    m_audioQueue.push_back(AudioChunk{ channel, buffer });
+    return true;
+}
+
 // New methods for queue handling
-void RealTimeTranscriber::enqueue_audio_data(const std::vector<char>& audio_data) {
+bool RealTimeTranscriber::enqueue_audio_data(int channel, const char* data, std::size_t size) {
     std::lock_guard<std::mutex> lock(m_audioQueueMutex);
-    m_audioQueue.push_back(audio_data);
+    if (!queue_audio(channel, data, size)) {
+        return false;
+    }
     m_queueCond.notify_one();
+    return true;
+}
+
+bool RealTimeTranscriber::dequeue_audio_data(AudioChunk& chunk) {
+    std::unique_lock<std::mutex> lock(m_audioQueueMutex);
+    m_queueCond.wait(lock, [this] { return !m_audioQueue.empty() || m_stopFlag.load(); });
+    if (m_stopFlag.load()) {
+        return false;
+    }
+    chunk = m_audioQueue.front();
+    m_audioQueue.pop_front();
+    return true;
+}
+
+void RealTimeTranscriber::release_audio_buffer(AudioBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    m_audioPool.release(buffer);
+}
+
+const std::string& RealTimeTranscriber::build_audio_frame(const char* data, std::size_t size) {
+    encode_audio_frame(data, size, m_frameBuffer);
+    return m_frameBuffer;
 }
 
 // New thread function for sending data
 void RealTimeTranscriber::send_audio_data_thread() {
     websocketpp::lib::error_code ec;
 
-    while (!m_stopFlag.load()) {
-        std::vector<char> audio_data;
+    AudioChunk chunk;
+    while (dequeue_audio_data(chunk)) {
+        // Lifecycle requests are handled in queue order, after the audio queued before them
+        if (chunk.kind == ChunkKind::SUSPEND) {
+            suspend_session(chunk.channel);
+            continue;
+        }
+        if (chunk.kind == ChunkKind::END_UTTERANCE) {
+            // The server answers with the final of the utterance right away
+            if (m_recorder) {
+                m_recorder->record(RecordKind::CONTROL_OUT, chunk.channel, m_forceEndMsg);
+            }
+            m_wsClient.send(m_sessions[chunk.channel].handle, m_forceEndMsg, websocketpp::frame::opcode::text, ec);
+            if (ec) {
+                std::cerr << "Force End Utterance Send failed on channel " << chunk.channel << ": " << ec.message() << std::endl;
+            }
+            continue;
+        }
+        if (chunk.kind == ChunkKind::RESUME) {
+            std::cout << "Resuming channel " << chunk.channel << std::endl;
+            if (!open_session(chunk.channel)) {
+                std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+                m_sessions[chunk.channel].lifecycle = Lifecycle::SUSPENDED; // Retry on the next speech
+            }
+            continue;
+        }
+
         {
-            std::unique_lock<std::mutex> lock(m_audioQueueMutex);
-            m_queueCond.wait(lock, [this] { return !m_audioQueue.empty() || m_stopFlag.load(); });
-            if (m_stopFlag.load()) {
-                break;
+            ALLOCATION_AUDIT_SCOPE();
+            if (m_recorder) {
+                m_recorder->record(RecordKind::AUDIO_OUT, chunk.channel, chunk.buffer->data(), chunk.buffer->size);
             }
-            audio_data = m_audioQueue.front();
-            m_audioQueue.pop_front();
+            build_audio_frame(chunk.buffer->data(), chunk.buffer->size);
+            release_audio_buffer(chunk.buffer);
         }
-        // Send the audio data using WebSocket
-        m_audioJSONBuffer["audio_data"] = websocketpp::base64_encode(reinterpret_cast<const unsigned char*>(audio_data.data()), audio_data.size());
-        m_wsClient.send(m_wsHandle, m_audioJSONBuffer.dump(), websocketpp::frame::opcode::text, ec);
+        // Send the audio data using the WebSocket of the chunk's channel (websocketpp copies it into a message of its own)
+        m_wsClient.send(m_sessions[chunk.channel].handle, m_frameBuffer.data(), m_frameBuffer.size(), websocketpp::frame::opcode::text, ec);
         if (ec) {
-            std::cout << "Audio Data Send failed: " << ec.message() << std::endl;
+            std::cout << "Audio Data Send failed on channel " << chunk.channel << ": " << ec.message() << std::endl;
         }
     }
-    // Once stop_flag is set, send the terminate message
-    m_wsClient.send(m_wsHandle, m_terminateMsg, websocketpp::frame::opcode::text, ec);
-    if (ec) {
-        std::cerr << "Terminate Session Send failed: " << ec.message() << std::endl;
+    // Once stop_flag is set, send the terminate message on every session that wasn't suspended already
+    for (int channel = 0; channel < m_channels; ++channel) {
+        {
+            std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+            if (m_sessions[channel].lifecycle == Lifecycle::SUSPENDED) {
+                continue;
+            }
+        }
+        if (m_recorder) {
+            m_recorder->record(RecordKind::CONTROL_OUT, channel, m_terminateMsg);
+        }
+        m_wsClient.send(m_sessions[channel].handle, m_terminateMsg, websocketpp::frame::opcode::text, ec);
+        if (ec) {
+            std::cerr << "Terminate Session Send failed on channel " << channel << ": " << ec.message() << std::endl;
+        }
     }
 
 }
 
+void RealTimeTranscriber::suspend_session(int channel) {
+    // The server answers with the last final and SessionTerminated, then closes the connection
+    websocketpp::lib::error_code ec;
+    if (m_recorder) {
+        m_recorder->record(RecordKind::CONTROL_OUT, channel, m_terminateMsg);
+    }
+    m_wsClient.send(m_sessions[channel].handle, m_terminateMsg, websocketpp::frame::opcode::text, ec);
+    if (ec) {
+        std::cerr << "Terminate Session Send failed on channel " << channel << ": " << ec.message() << std::endl;
+    }
+    std::cout << "Channel " << channel << " suspended after " << m_idleSuspend.idleTimeout.count() << " ms idle" << std::endl;
+}
+
 // Define a callback to handle incoming messages
-void RealTimeTranscriber::on_message(connection_hdl hdl, message_ptr msg) {
-    // Parse the JSON message
-    nlohmann::json json_msg = nlohmann::json::parse(msg->get_payload());
+void RealTimeTranscriber::on_message(int channel, connection_hdl hdl, message_ptr msg) {
+    if (m_recorder) {
+        m_recorder->record(RecordKind::MESSAGE_IN, channel, msg->get_payload());
+    }
+    handle_message(channel, msg->get_payload());
+}
+
+void RealTimeTranscriber::handle_message(int channel, const std::string& payload) {
+    {
+        // Transcripts are read in place, into buffers that keep their capacity
+        ALLOCATION_AUDIT_SCOPE();
+        if (!json_find_string(payload, "message_type", m_messageType)) {
+            std::cerr << "Received malformed message: " << payload << std::endl;
+            return;
+        }
 
-    // Extract the message type
-    std::string message_type = json_msg["message_type"];
+        // Label speakers by channel when several sessions share the console
+        if (m_channels > 1) {
+            std::cout << "[ch " << channel << "] ";
+        }
 
-    if (message_type == "PartialTranscript") {
-        std::string text = json_msg["text"];
-        std::cout << text << "\r";
+        const bool is_final = m_messageType == "FinalTranscript";
+        if (is_final || m_messageType == "PartialTranscript") {
+            if (!json_find_string(payload, "text", m_messageText)) {
+                std::cerr << "Received " << m_messageType << " without a readable text: " << payload << std::endl;
+                return;
+            }
+            publish_transcript(channel, m_messageText, is_final);
+            std::cout << m_messageText << (is_final ? "\r\n" : "\r");
+            m_transcriptionTimestamp = std::chrono::high_resolution_clock::now();
+            std::cout << "Time taken for transcription: "
+                        << std::chrono::duration_cast<std::chrono::milliseconds>(m_transcriptionTimestamp - m_inputTimestamp).count()
+                        << " ms"
+                        << std::endl;
+            return;
+        }
     }
-    else if (message_type == "FinalTranscript") {
-		std::string text = json_msg["text"];
-        std::cout << text << "\r\n";
-	}
-    else if (message_type == "SessionBegins") {
+
+    // Session messages are rare, parse them fully
+    nlohmann::json json_msg = nlohmann::json::parse(payload);
+    if (m_messageType == "SessionBegins") {
 		std::string session_id = json_msg["session_id"];
 		std::string expires_at = json_msg["expires_at"];
 		std::cout << "Session started with ID: " << session_id << " and expires at: " << expires_at << std::endl;
 	}
-    else if (message_type == "SessionTerminated") {
+    else if (m_messageType == "SessionTerminated") {
 		std::cout << "Session terminated." << std::endl;
 	}
     else {
-		std::cout << "Received unknown message type: " << message_type << std::endl;
-	}   
-    
-    m_transcriptionTimestamp = std::chrono::high_resolution_clock::now();
-    std::cout << "Time taken for transcription: "
-                << std::chrono::duration_cast<std::chrono::milliseconds>(m_transcriptionTimestamp - m_inputTimestamp).count()
-                << " ms"
-                << std::endl;
+		std::cout << "Received unknown message type: " << m_messageType << std::endl;
+	}
+}
+
+void RealTimeTranscriber::publish_transcript(int channel, const std::string& text, bool is_final) {
+    ChannelSession& session = m_sessions[channel];
+    const auto now = std::chrono::steady_clock::now();
 
+    // Empty partials are silence, they don't change the utterance. An empty final still ends it: it goes
+    // through the differ (dropping the partial text) and out as a FINAL, so consumers see the utterance close.
+    if (text.empty() && !is_final) {
+        return;
+    }
+    const TranscriptDelta& delta = session.transcriptDiff.update(text, is_final);
+    {
+        // A transcript is activity too, so a slow final doesn't get its session suspended
+        std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+        if (!text.empty()) {
+            session.lastActivity = now;
+        }
+        if (is_final) {
+            session.endpointer.on_final(!text.empty(), now);
+        }
+        else {
+            session.endpointer.on_partial(delta.removed > 0 || !delta.suffix.empty(), now);
+        }
+    }
+    if (m_transcriptChannel) {
+        m_transcriptChannel->publish(channel, delta, text);
+    }
+    if (m_transcriptHandler) {
+        m_transcriptHandler(channel, delta);
+    }
 }
 
-void RealTimeTranscriber::on_open(connection_hdl hdl) {
-    std::cout << "Connection opened" << std::endl;
-    m_isConnected.store(true);
+void RealTimeTranscriber::on_open(int channel, connection_hdl hdl) {
+    websocketpp::lib::error_code ec;
+    std::string tlsSession;
+    client::connection_ptr con = m_wsClient.get_con_from_hdl(hdl, ec);
+    if (!ec) {
+        SSL* ssl = con->get_socket().native_handle();
+        tlsSession = std::string(SSL_get_version(ssl)) + " " + SSL_get_cipher_name(ssl);
+    }
+    std::cout << "Connection opened (channel " << channel << ", " << tlsSession << ")" << std::endl;
+    if (m_recorder) {
+        m_recorder->record(RecordKind::OPEN, channel, nullptr, 0);
+    }
+
+    // Server silence threshold, before any audio (a backstop when client endpointing is on)
+    if (m_endpointing.serverSilenceThreshold.count() > 0) {
+        const std::string configure = nlohmann::json{ {"end_utterance_silence_threshold", m_endpointing.serverSilenceThreshold.count()} }.dump();
+        if (m_recorder) {
+            m_recorder->record(RecordKind::CONTROL_OUT, channel, configure);
+        }
+        m_wsClient.send(hdl, configure, websocketpp::frame::opcode::text, ec);
+        if (ec) {
+            std::cerr << "End Utterance Threshold Send failed on channel " << channel << ": " << ec.message() << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    ChannelSession& session = m_sessions[channel];
+    if (!same_connection(hdl, session.handle)) {
+        return;
+    }
+    session.connection = ConnectionState::OPEN;
+    session.tlsSession = tlsSession;
+    session.endpointer.on_reconnect();
+
+    // A resumed session sends its pre-roll first, live audio queues up behind it
+    if (session.lifecycle == Lifecycle::RESUMING) {
+        std::cout << "Channel " << channel << " resumed, flushing " << session.preRollBytes * 1000 / (m_sampleRate * sizeof(int16_t)) << " ms of pre-roll" << std::endl;
+        for (; !session.preRoll.empty(); session.preRoll.pop_front()) {
+            if (!m_audioQueue.push_back(AudioChunk{ channel, session.preRoll.front() })) {
+                m_audioPool.release(session.preRoll.front());
+                m_droppedChunks++;
+            }
+        }
+        session.preRollBytes = 0;
+        session.lifecycle = Lifecycle::ACTIVE;
+        session.lastActivity = std::chrono::steady_clock::now();
+        m_queueCond.notify_one();
+    }
 }
 
-void RealTimeTranscriber::on_close(connection_hdl hdl) {
-    std::cout << "Connection closed" << std::endl;
-    m_isConnected.store(false);
+void RealTimeTranscriber::on_close(int channel, connection_hdl hdl) {
+    std::cout << "Connection closed (channel " << channel << ")" << std::endl;
+    if (m_recorder) {
+        m_recorder->record(RecordKind::CLOSE, channel, nullptr, 0);
+    }
+
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    if (same_connection(hdl, m_sessions[channel].handle)) {
+        m_sessions[channel].connection = ConnectionState::CLOSED;
+    }
 }
 
-context_ptr RealTimeTranscriber::on_tls_init(connection_hdl hdl) {
-    context_ptr ctx = websocketpp::lib::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
-    try {
-        ctx->set_options(
-            boost::asio::ssl::context::default_workarounds |
-            boost::asio::ssl::context::no_sslv2 |
-            boost::asio::ssl::context::no_sslv3 |
-            boost::asio::ssl::context::single_dh_use
-        );
+void RealTimeTranscriber::on_fail(int channel, connection_hdl hdl) {
+    std::cerr << "Connection failed (channel " << channel << ")" << std::endl;
+
+    // A failed resume goes back to suspended, the next speech retries
+    std::lock_guard<std::mutex> lock(m_audioQueueMutex);
+    if (!same_connection(hdl, m_sessions[channel].handle)) {
+        return;
     }
-    catch (std::exception& e) {
-        std::cout << "Error in context pointer: " << e.what() << std::endl;
+    m_sessions[channel].connection = ConnectionState::CLOSED;
+    if (m_sessions[channel].lifecycle == Lifecycle::RESUMING) {
+        m_sessions[channel].lifecycle = Lifecycle::SUSPENDED;
     }
+}
+
+context_ptr RealTimeTranscriber::on_tls_init(connection_hdl hdl) {
+    // tls_client negotiates the highest version both sides support, the profile sets the floor, the ceiling and the ciphers
+    context_ptr ctx = websocketpp::lib::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client);
+    apply_tls_options(*ctx, m_transport);
     return ctx;
-}
\ No newline at end of file
+}
+
+void RealTimeTranscriber::on_tcp_pre_init(connection_hdl hdl) {
+    // The socket-init hook runs before the socket is connected (and async_connect reopens it), so options are set here:
+    // after the TCP connect, before the TLS handshake
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = m_wsClient.get_con_from_hdl(hdl, ec);
+    if (ec) {
+        return;
+    }
+    apply_socket_options(con->get_socket().lowest_layer(), m_transport);
+}
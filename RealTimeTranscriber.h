@@ -13,13 +13,26 @@
 #define REALTIMETRANSCRIBER_H
 
 #include "portaudio.h"
+#include "AudioRuntime.h"
+#include "TranscriptDiff.h"
+#include "CapturePipeline.h"
+#include "SessionRecorder.h"
+#include "TranscriptChannel.h"
+#include "AudioPool.h"
+#include "WireFormat.h"
+#include "AllocationAudit.h"
+#include "TransportProfile.h"
+#include "Endpointer.h"
 #include <nlohmann/json.hpp>
-#include <websocketpp/base64/base64.hpp>
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/client.hpp>
 
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -32,6 +45,20 @@ namespace ChatBot {
     typedef client::message_ptr message_ptr;
     typedef websocketpp::connection_hdl connection_hdl;
     typedef websocketpp::lib::shared_ptr<boost::asio::ssl::context> context_ptr;
+    typedef std::function<void(int channel, const TranscriptDelta&)> transcript_handler; ///< Called on the WebSocket thread for every non-empty partial and every final, empty ones included
+
+    /// @brief Where a transcriber gets its audio from
+    enum class AudioSource {
+        MICROPHONE = 0, ///< PortAudio capture from the selected (by default the host's default) input device
+        EXTERNAL = 1,   ///< Caller feeds audio with push_audio (replay, load tests)
+    };
+
+    /// @brief Auto-suspend of idle sessions: the server session ends after a quiet period and reconnects on speech
+    struct IdleSuspendConfig {
+        std::chrono::milliseconds idleTimeout{ 0 }; ///< Quiet time (no speech, no transcript) before a session is ended, 0 disables auto-suspend
+        std::chrono::milliseconds preRoll{ 1000 }; ///< Audio kept while suspended and sent first on resume
+        double energyThreshold{ 300.0 }; ///< RMS level (PCM16) above which a chunk counts as speech
+    };
 
     using websocketpp::lib::placeholders::_1;
     using websocketpp::lib::placeholders::_2;
@@ -40,69 +67,177 @@ namespace ChatBot {
     class RealTimeTranscriber
     {
     public:
-        RealTimeTranscriber(int sample_rate); ///< Constructor for RealTimeTranscriber class: initializes member variables
+        RealTimeTranscriber(int sample_rate, int channels = 1, PaSampleFormat format = paInt16, std::chrono::milliseconds chunk = std::chrono::milliseconds(200)); ///< Constructor for RealTimeTranscriber class: initializes member variables, one session per input channel
         ~RealTimeTranscriber(); ///< Destructor for RealTimeTranscriber class: stops transcription and frees resources
 
         void start_transcription(); ///< Starts transcription
         void stop_transcription(); ///< Stops transcription
 
+        void set_transcript_handler(transcript_handler handler); ///< Registers a consumer for transcript deltas (call before start_transcription)
+        void set_endpoint(const std::string& uri); ///< Overrides the real-time endpoint, e.g. a local stand-in server, whose connections then carry an X-Channel header (call before start_transcription)
+        void set_audio_source(AudioSource source); ///< Chooses between PortAudio capture and push_audio (call before start_transcription)
+        bool enable_recording(const std::string& path); ///< Records every chunk sent and message received to a session log (call before start_transcription)
+        bool enable_transcript_channel(const std::string& name); ///< Publishes every transcript to a shared-memory ring other local processes read (call before start_transcription)
+        void set_idle_suspend(const IdleSuspendConfig& config); ///< Enables auto-suspend of idle channel sessions (call before start_transcription)
+        void set_transport_profile(const TransportProfile& profile); ///< Sets the socket and TLS options of every connection (call before start_transcription)
+        void set_input_device(const std::string& device); ///< Captures from a device by name or id instead of the default one (call before start_transcription)
+        void set_endpointing(const EndpointingConfig& config); ///< Ends utterances from local silence and partial stability instead of waiting for the server (call before start_transcription)
+
+        bool push_audio(int channel, const std::vector<char>& audio_data); ///< Queues PCM16 audio (at most one chunk, as passed to the constructor) for a channel's session when the audio source is EXTERNAL
+        bool is_session_open(int channel) const; ///< True if the WebSocket connection of a channel is open
+        uint64_t get_dropped_chunks() const; ///< Chunks dropped because the send queue or the buffer pool was full
+        std::size_t get_queue_depth() const; ///< Chunks waiting in the send queue, every channel
+        std::future<std::size_t> request_buffered_bytes(int channel); ///< Asks the WebSocket thread for the bytes a channel's connection has framed but not yet written to its socket (0 if not connected)
+        std::optional<std::size_t> get_buffered_bytes(int channel); ///< request_buffered_bytes, waiting up to 100 ms (nullopt if the WebSocket thread doesn't answer)
+        std::string get_tls_session(int channel) const; ///< TLS version and cipher negotiated by a channel's connection, empty until it opens
+        EndpointingStats get_endpointing_stats(int channel) const; ///< End-of-speech to final latency of a channel's recent utterances
+
     private:
+        friend struct TranscriberBench; ///< Microbenchmarks drive the hot paths without network or audio hardware
+
         static int pa_callback(
-            const void* inputBuffer, 
-            void* outputBuffer,
+            const void* inputBuffer,
             unsigned long framesPerBuffer,
-            const PaStreamCallbackTimeInfo* timeInfo,
-            PaStreamCallbackFlags statusFlags,
+            std::chrono::steady_clock::time_point captured,
             void* userData
-        ); ///< PortAudio callback function
+        ); ///< Capture callback of the leased PortAudio stream
+
+        /// @brief Server-side state of a channel session under auto-suspend
+        enum class Lifecycle {
+            ACTIVE = 0,    ///< Connected (or connecting), audio is sent
+            SUSPENDED = 1, ///< Server session ended for idleness, audio goes to the pre-roll
+            RESUMING = 2,  ///< Reconnecting after speech, audio goes to the pre-roll until the connection opens
+        };
+
+        /// @brief State of a channel's current WebSocket connection, tracked by the handlers
+        enum class ConnectionState {
+            CONNECTING = 0, ///< Handshake in progress, audio is dropped
+            OPEN = 1,       ///< Audio is sent
+            CLOSED = 2,     ///< Closed or failed
+        };
+
+        /// @brief Transcription session fed by one input channel
+        struct ChannelSession {
+            client::connection_ptr con; ///< WebSocket connection pointer
+            connection_hdl handle; ///< WebSocket connection handle
+            TranscriptDiffer transcriptDiff; ///< Word-aligned diff between consecutive transcripts
+            std::string tlsSession; ///< Negotiated TLS version and cipher, guarded by m_audioQueueMutex
+
+            // Guarded by m_audioQueueMutex
+            ConnectionState connection{ ConnectionState::CONNECTING }; ///< Read by the capture thread instead of locking the connection
+            Lifecycle lifecycle{ Lifecycle::ACTIVE }; ///< Whether the server session is live
+            std::chrono::steady_clock::time_point lastActivity; ///< Last chunk with speech or last non-empty transcript
+            FixedRing<AudioBuffer*> preRoll; ///< Most recent audio captured while suspended or resuming
+            std::size_t preRollBytes{ 0 }; ///< Bytes held in preRoll
+            Endpointer endpointer; ///< End-of-utterance detection and capture-to-final latency
+        };
+
+        /// @brief What a queued item asks the send thread to do
+        enum class ChunkKind {
+            AUDIO = 0,   ///< Send the data on the channel's session
+            SUSPEND = 1, ///< End the channel's server session (idle)
+            RESUME = 2,  ///< Reconnect the channel's session (speech after idle)
+            END_UTTERANCE = 3, ///< Ask the server to end the channel's current utterance now
+        };
+
+        /// @brief Result of routing a chunk of captured audio
+        enum class RouteResult {
+            QUEUED = 0,  ///< Queued for sending or kept in the pre-roll
+            DROPPED = 1, ///< Session still connecting, audio dropped
+            CLOSED = 2,  ///< Session closed by the server
+        };
+
+        /// @brief Audio waiting to be sent, tagged with the channel session it belongs to
+        struct AudioChunk {
+            int channel{ 0 }; ///< Index into m_sessions
+            AudioBuffer* buffer{ nullptr }; ///< PCM16 bytes from m_audioPool, null for lifecycle requests
+            ChunkKind kind{ ChunkKind::AUDIO }; ///< Audio or a lifecycle request handled in queue order
+        };
 
         // PortAudio functions
-        int on_audio_data(const void* inputBuffer, unsigned long framesPerBuffer); ///< Implementation of PortAudio callback function
-        void enqueue_audio_data(const std::vector<char>& audio_data); ///< Enqueues audio data to be sent
-        void send_audio_data_thread(); ///< Thread for sending audio data
+        bool open_audio_stream(); ///< Leases (or reuses) the capture stream of the input device and starts it
+        bool open_session(int channel); ///< Creates and connects the WebSocket connection of a channel
+        client::connection_ptr create_session(int channel); ///< Creates a channel's connection without queuing its connect, null on failure
+        void discard_sessions(); ///< Drops connections created by a start that failed before connecting them
+        void prepare_buffers(); ///< Sizes the send queue, pre-rolls and buffer pool so the steady state doesn't allocate
+        RouteResult route_audio(int channel, const char* data, std::size_t size, std::chrono::steady_clock::time_point captured); ///< Queues audio or keeps it in the pre-roll, depending on the session's lifecycle (captured: when its last frame was captured)
+        double mean_square(const char* data, std::size_t size) const; ///< Squared RMS level of a PCM16 chunk, compared against squared speech thresholds
+        void suspend_session(int channel); ///< Ends an idle channel's server session (send thread)
+        int on_audio_data(const void* inputBuffer, unsigned long framesPerBuffer, std::chrono::steady_clock::time_point captured); ///< Implementation of PortAudio callback function
+        bool queue_audio(int channel, const char* data, std::size_t size); ///< Copies audio into a pooled buffer and queues it, m_audioQueueMutex must be held
+        bool enqueue_audio_data(int channel, const char* data, std::size_t size); ///< Enqueues audio data to be sent on a channel's session
+        bool dequeue_audio_data(AudioChunk& chunk); ///< Waits for the next chunk to send, false once transcription is stopped
+        void release_audio_buffer(AudioBuffer* buffer); ///< Returns a sent chunk's buffer to the pool
+        const std::string& build_audio_frame(const char* data, std::size_t size); ///< Builds the JSON text frame carrying base64 audio into m_frameBuffer
+        void send_audio_data_thread(); ///< Thread for sending audio data of every channel
 
         // WebSocket binding functions
-        void on_message(connection_hdl hdl, message_ptr msg);
-        void on_open(connection_hdl hdl);
-        void on_close(connection_hdl hdl);
+        void on_message(int channel, connection_hdl hdl, message_ptr msg);
+        void handle_message(int channel, const std::string& payload); ///< Parses and dispatches a server message
+        void on_open(int channel, connection_hdl hdl);
+        void on_close(int channel, connection_hdl hdl);
+        void on_fail(int channel, connection_hdl hdl);
         context_ptr on_tls_init(connection_hdl hdl);
+        void on_tcp_pre_init(connection_hdl hdl); ///< Applies the transport profile's socket options once TCP is connected
 
-        // WebSocket client and connection handle
+        void publish_transcript(int channel, const std::string& text, bool is_final); ///< Diffs a transcript against the previous one and hands the delta to the consumer
+
+        // WebSocket client shared by every channel session
         client m_wsClient; ///< WebSocket client
-        client::connection_ptr m_con = nullptr; ///< WebSocket connection pointer
-        connection_hdl m_wsHandle; ///< WebSocket connection handle
-        websocketpp::lib::error_code m_wsError; ///< WebSocket error code
 
         // Termination message created in constructor
         nlohmann::json m_terminateJSON{ {"terminate_session", true} }; ///< JSON payload for terminating session
         std::string m_terminateMsg{ m_terminateJSON.dump() }; ///< Terminate session message
-
-        // Audio buffers for sending data are initialized in constructor to avoid reallocation
-        std::vector<char> m_audioDataBuffer; ///< Buffer for audio data
-        nlohmann::json m_audioJSONBuffer; ///< Buffer for audio JSON payload
+        nlohmann::json m_forceEndJSON{ {"force_end_utterance", true} }; ///< JSON payload for ending the current utterance
+        std::string m_forceEndMsg{ m_forceEndJSON.dump() }; ///< Force end of utterance message
+
+        // Audio buffers are allocated in the constructor and prepare_buffers(), never on the audio path
+        std::vector<ChannelSession> m_sessions; ///< One session per input channel
+        std::unique_ptr<CapturePipeline> m_capture; ///< Splits capture buffers into PCM16 chunks, specialized for the capture format
+        AudioBufferPool m_audioPool; ///< Buffers for queued and pre-rolled audio
+        std::string m_frameBuffer; ///< JSON text frame being sent (send thread)
+        std::string m_messageType; ///< Message type of the message being handled (WebSocket thread)
+        std::string m_messageText; ///< Transcript text of the message being handled (WebSocket thread)
+        std::atomic<uint64_t> m_droppedChunks{ 0 }; ///< Chunks dropped for lack of queue space or buffers
 
         // Threads stuff
         std::thread m_wsThread; ///< Thread for running the WebSocket client's ASIO io_service
         std::atomic<bool> m_isConnected{ false }; ///< Indicates if the WebSocket connection is open
 
         std::thread m_sendThread; ///< Thread for sending audio data
-        std::deque<std::vector<char>> m_audioQueue; ///< Queue for audio data
+        FixedRing<AudioChunk> m_audioQueue; ///< Queue for audio data of every channel
         std::condition_variable m_queueCond; ///< Condition variable for queue
         std::atomic<bool> m_stopFlag{ false }; ///< Indicates if the transcription has been stopped
 
         std::mutex m_startStopMutex; ///< Mutex for protecting start/stop functions
-        std::mutex m_audioQueueMutex; ///< Mutex for protecting audio buffers
+        mutable std::mutex m_audioQueueMutex; ///< Mutex for protecting audio buffers and session lifecycles
 
         // PortAudio stream
-        PaStream* m_audioStream{ nullptr }; ///< PortAudio stream pointer
+        std::shared_ptr<AudioRuntime> m_audio; ///< Process-wide PortAudio runtime
+        std::unique_ptr<InputStreamLease> m_audioStream; ///< Capture stream, kept across restarts and returned to the runtime on destruction
         PaError m_audioErr{ paNoError }; ///< PortAudio error code
+        std::string m_inputDevice; ///< Input device name or id, empty for the default device
+
+        // Session recording (opt-in)
+        std::unique_ptr<SessionRecorder> m_recorder; ///< Session log writer, null unless recording is enabled
+
+        // Transcript channel for other processes (opt-in)
+        std::unique_ptr<TranscriptPublisher> m_transcriptChannel; ///< Shared-memory transcript ring, null unless enabled
 
         // Configuration parameters
+        std::string m_endpoint; ///< Real-time endpoint, without query, the service's unless set_endpoint was called
+        AudioSource m_audioSource{ AudioSource::MICROPHONE }; ///< Where audio comes from
+        IdleSuspendConfig m_idleSuspend; ///< Auto-suspend settings, disabled by default
+        EndpointingConfig m_endpointing; ///< Client endpointing settings, server endpointing by default
+        TransportProfile m_transport; ///< Socket and TLS settings, low latency by default
         const std::string m_aaiAPItoken{ "fb401df1f67247c9a8aaf02d4dd785ee" }; ///< We'll want this to be configurable
         const int m_sampleRate; ///< 16kHz is adequate for speech recognition
         const int m_framesPerBuffer; ///< 100ms to 2000ms of audio data per message (0.1 * sampleRate -> 2.0 * sampleRate)
-        const PaSampleFormat m_format{ paInt16 }; ///< WAV PCM16
-        const int m_channels{ 1 }; ///< Mono (single-channel)
+        const PaSampleFormat m_format; ///< Capture sample format (int16, int32 or float32), always sent as PCM16
+        const int m_channels; ///< Input channels captured by one stream, each one transcribed separately
+
+        // Transcript consumers
+        transcript_handler m_transcriptHandler; ///< Consumer of transcript deltas
 
         // Performance trackers
         std::chrono::high_resolution_clock::time_point m_inputTimestamp{std::chrono::high_resolution_clock::now()};
@@ -0,0 +1,273 @@
+/**
+ * @file SessionRecorder.cpp
+ * @author zah
+ * @brief Implementation of SessionRecorder and SessionReader classes
+ * @version 0.1
+ * @date 2024-02-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "SessionRecorder.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace bip = boost::interprocess;
+
+static_assert(sizeof(SessionLogHeader) == 32, "Session log header must stay 32 bytes");
+static_assert(sizeof(SessionRecordHeader) == 16, "Session record header must stay 16 bytes");
+
+namespace {
+    const char s_magic[8] = { 'A', 'A', 'I', 'R', 'E', 'C', '\0', '\1' };
+
+    std::size_t padded(std::size_t length) {
+        return (length + 7) & ~std::size_t(7);
+    }
+} // namespace
+
+
+SessionRecorder::SessionRecorder(const std::string& path, int sampleRate, int channels, int chunkFrames)
+    : m_path(path)
+    , m_start(std::chrono::steady_clock::now())
+{
+    // Create (or truncate) the file, then map the first segment
+    {
+        std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Session recorder could not create " << m_path << std::endl;
+            return;
+        }
+    }
+    try {
+        m_mapping = bip::file_mapping(m_path.c_str(), bip::read_write);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Session recorder could not map " << m_path << ": " << e.what() << std::endl;
+        return;
+    }
+    if (!map_segment(0, m_region)) {
+        return;
+    }
+
+    SessionLogHeader header{};
+    std::memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = s_version;
+    header.sampleRate = static_cast<uint32_t>(sampleRate);
+    header.channels = static_cast<uint32_t>(channels);
+    header.chunkFrames = static_cast<uint32_t>(chunkFrames);
+    header.startEpochNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::memcpy(m_region.get_address(), &header, sizeof(header));
+    m_used = sizeof(header);
+
+    m_isOpen = true;
+    m_grower = std::thread(&SessionRecorder::grow, this); // Maps the second segment right away
+}
+
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+bool SessionRecorder::isOpen() const {
+    return m_isOpen;
+}
+
+void SessionRecorder::record(RecordKind kind, int channel, const void* data, std::size_t length) {
+    SessionRecordHeader header{};
+    header.length = static_cast<uint32_t>(length);
+    header.kind = kind;
+    header.channel = static_cast<uint8_t>(channel);
+
+    // Every record leaves room behind it for the zeroed end marker, or for the padding record of a segment switch
+    const std::size_t size = sizeof(header) + padded(length);
+    if (size + sizeof(header) > s_segmentSize) {
+        std::cerr << "Session recorder dropped a " << length << " byte record, larger than a segment" << std::endl;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_isOpen) {
+        return;
+    }
+    if (!make_room(lock, size + sizeof(header))) {
+        return;
+    }
+
+    // Timed under the lock, so offsets never go back in file order
+    header.offsetNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    char* out = static_cast<char*>(m_region.get_address()) + (m_used - m_segmentStart);
+    std::memcpy(out, &header, sizeof(header));
+    if (length > 0) {
+        std::memcpy(out + sizeof(header), data, length); // Padding is already zero, the file grows zero-filled
+    }
+    m_used += size;
+}
+
+void SessionRecorder::record(RecordKind kind, int channel, std::string_view text) {
+    record(kind, channel, text.data(), text.size());
+}
+
+void SessionRecorder::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_isOpen) {
+            return;
+        }
+        m_isOpen = false;
+    }
+    m_growCond.notify_all();
+    if (m_grower.joinable()) {
+        m_grower.join();
+    }
+
+    // Nobody touches the segments once closed. Unmap before trimming, the file can't shrink under a live mapping on every platform
+    m_region.flush();
+    m_region = bip::mapped_region();
+    m_spare = bip::mapped_region();
+    m_retired = bip::mapped_region();
+    m_mapping = bip::file_mapping();
+    std::error_code ec;
+    std::filesystem::resize_file(m_path, m_used + sizeof(SessionRecordHeader), ec); // Keep a zeroed end marker
+    if (ec) {
+        std::cerr << "Session recorder could not trim " << m_path << ": " << ec.message() << std::endl;
+    }
+}
+
+bool SessionRecorder::map_segment(std::size_t offset, bip::mapped_region& region) {
+    try {
+        // Only ever grows: the constructor maps the first segment, then only the grower extends the file
+        std::filesystem::resize_file(m_path, offset + s_segmentSize);
+        region = bip::mapped_region(m_mapping, bip::read_write, offset, s_segmentSize);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Session recorder could not map " << m_path << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    // Take the page faults (and block allocation of the sparse file) here rather than on the first records
+    volatile char* pages = static_cast<char*>(region.get_address());
+    const std::size_t pageSize = bip::mapped_region::get_page_size();
+    for (std::size_t i = 0; i < s_segmentSize; i += pageSize) {
+        pages[i] = 0;
+    }
+    return true;
+}
+
+bool SessionRecorder::make_room(std::unique_lock<std::mutex>& lock, std::size_t size) {
+    if (m_used - m_segmentStart + size <= s_segmentSize) {
+        return true;
+    }
+
+    // The grower maps a segment ahead, only a burst of more than a segment's worth of records waits here
+    m_growCond.wait(lock, [this] { return m_spareReady || m_growFailed || !m_isOpen; });
+    if (!m_isOpen) {
+        return false;
+    }
+    if (m_used - m_segmentStart + size <= s_segmentSize) {
+        return true; // Another writer switched segments while this one waited
+    }
+    if (!m_spareReady) {
+        return false;
+    }
+
+    // Every record left room for this header, so readers step from here to the next segment
+    SessionRecordHeader pad{};
+    pad.length = static_cast<uint32_t>(s_segmentSize - (m_used - m_segmentStart) - sizeof(pad));
+    pad.kind = RecordKind::PAD;
+    std::memcpy(static_cast<char*>(m_region.get_address()) + (m_used - m_segmentStart), &pad, sizeof(pad));
+
+    m_retired = std::move(m_region);
+    m_region = std::move(m_spare);
+    m_spareReady = false;
+    m_segmentStart += s_segmentSize;
+    m_used = m_segmentStart;
+    m_growCond.notify_all();
+    return true;
+}
+
+void SessionRecorder::grow() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_growCond.wait(lock, [this] { return !m_isOpen || (!m_spareReady && !m_growFailed) || m_retired.get_address() != nullptr; });
+        if (!m_isOpen) {
+            return;
+        }
+        bip::mapped_region retired(std::move(m_retired));
+        const bool mapSpare = !m_spareReady && !m_growFailed;
+        const std::size_t offset = m_segmentStart + s_segmentSize; // Writers can't move past the current segment without the spare
+        lock.unlock();
+
+        retired = bip::mapped_region(); // Unmapping a segment of dirty pages isn't free either
+        bip::mapped_region spare;
+        const bool mapped = mapSpare && map_segment(offset, spare);
+
+        lock.lock();
+        if (mapSpare) {
+            if (mapped) {
+                m_spare = std::move(spare);
+                m_spareReady = true;
+            }
+            else {
+                m_growFailed = true;
+            }
+            m_growCond.notify_all();
+        }
+    }
+}
+
+
+SessionReader::SessionReader(const std::string& path) {
+    try {
+        m_mapping = bip::file_mapping(path.c_str(), bip::read_only);
+        m_region = bip::mapped_region(m_mapping, bip::read_only);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Session reader could not map " << path << ": " << e.what() << std::endl;
+        return;
+    }
+
+    if (m_region.get_size() < sizeof(SessionLogHeader)) {
+        std::cerr << path << " is too short to be a session log" << std::endl;
+        return;
+    }
+    std::memcpy(&m_header, m_region.get_address(), sizeof(m_header));
+    if (std::memcmp(m_header.magic, s_magic, sizeof(s_magic)) != 0 || m_header.version != SessionRecorder::s_version) {
+        std::cerr << path << " is not a version " << SessionRecorder::s_version << " session log" << std::endl;
+        return;
+    }
+
+    m_offset = sizeof(SessionLogHeader);
+    m_isOpen = true;
+}
+
+bool SessionReader::isOpen() const {
+    return m_isOpen;
+}
+
+const SessionLogHeader& SessionReader::getHeader() const {
+    return m_header;
+}
+
+bool SessionReader::next(SessionRecord& record) {
+    do {
+        if (!m_isOpen || m_offset + sizeof(SessionRecordHeader) > m_region.get_size()) {
+            return false;
+        }
+
+        const char* in = static_cast<const char*>(m_region.get_address()) + m_offset;
+        std::memcpy(&record.header, in, sizeof(record.header));
+        if (record.header.kind == RecordKind::END || m_offset + sizeof(SessionRecordHeader) + record.header.length > m_region.get_size()) {
+            return false;
+        }
+
+        record.payload = std::string_view(in + sizeof(SessionRecordHeader), record.header.length);
+        m_offset += sizeof(SessionRecordHeader) + padded(record.header.length);
+    } while (record.header.kind == RecordKind::PAD); // End of a file segment
+    return true;
+}
+
+void SessionReader::rewind() {
+    m_offset = sizeof(SessionLogHeader);
+}
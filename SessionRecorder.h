@@ -0,0 +1,130 @@
+/**
+* @file SessionRecorder.h
+* @author zah
+* @brief Header for SessionRecorder and SessionReader classes: compact append-only binary log of a transcription session
+* @version 0.1
+* @date 2024-02-02
+*
+* @copyright Copyright (c) 2024
+*
+* Layout (little endian, every record starts on an 8-byte boundary):
+*   file header   : char magic[8] "AAIREC\0\1", uint32 version, uint32 sampleRate, uint32 channels, uint32 chunkFrames, uint64 startEpochNs
+*   record header : uint64 offsetNs (since recording started), uint32 length, uint8 kind, uint8 channel, uint16 reserved
+*   payload       : length bytes, zero padded to 8 bytes
+* A record with kind 0 (zero-filled, not yet written space) ends the log, so a log cut short by a crash stays readable.
+* The file is written in 4 MiB segments and no record crosses a segment boundary: a padding record (kind 6)
+* fills the end of a segment that the next record doesn't fit in.
+*/
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/// @brief What a log record holds
+enum class RecordKind : uint8_t {
+    END = 0,         ///< Unwritten space, end of the log
+    AUDIO_OUT = 1,   ///< PCM16 audio of one channel as handed to the send thread (raw, not base64)
+    CONTROL_OUT = 2, ///< Text frame sent by the client other than audio (terminate, configuration)
+    MESSAGE_IN = 3,  ///< Text frame received from the server
+    OPEN = 4,        ///< WebSocket connection of a channel opened
+    CLOSE = 5,       ///< WebSocket connection of a channel closed
+    PAD = 6,         ///< Unused end of a file segment, skipped by readers
+};
+
+/// @brief Header at the start of a session log
+struct SessionLogHeader {
+    char magic[8]; ///< "AAIREC\0\1"
+    uint32_t version; ///< Format version, see SessionRecorder::s_version
+    uint32_t sampleRate; ///< Sample rate of the recorded audio
+    uint32_t channels; ///< Channel sessions in the recording
+    uint32_t chunkFrames; ///< Frames per audio chunk of the recording transcriber, a replay pushes chunks of this size
+    uint64_t startEpochNs; ///< Wall clock time the recording started, nanoseconds since the Unix epoch
+};
+
+/// @brief Header in front of every record payload
+struct SessionRecordHeader {
+    uint64_t offsetNs; ///< Time since the recording started
+    uint32_t length; ///< Payload bytes (without padding)
+    RecordKind kind; ///< What the payload holds
+    uint8_t channel; ///< Channel session the record belongs to
+    uint16_t reserved; ///< Zero
+};
+
+/// @brief Appends timestamped records to a memory-mapped log file
+///
+/// Appending is a memcpy into the mapping under a short lock. A grower thread keeps the next segment
+/// of the file sized, mapped and faulted in, and unmaps finished ones, so the send and receive threads
+/// never resize, map or unmap the file themselves.
+class SessionRecorder {
+public:
+    SessionRecorder(const std::string& path, int sampleRate, int channels, int chunkFrames); ///< Constructor for SessionRecorder class: creates the file, maps the first segment and starts the grower
+    ~SessionRecorder(); ///< Destructor for SessionRecorder class: trims the file to what was written
+
+    bool isOpen() const; ///< True if the log file could be created and mapped
+
+    void record(RecordKind kind, int channel, const void* data, std::size_t length); ///< Appends one record (thread-safe)
+    void record(RecordKind kind, int channel, std::string_view text); ///< Appends one text record (thread-safe)
+
+    void close(); ///< Stops the grower, trims the file and unmaps it, later records are dropped
+
+    static constexpr uint32_t s_version = 2; ///< Current format version
+
+private:
+    bool map_segment(std::size_t offset, boost::interprocess::mapped_region& region); ///< Extends the file to hold the segment at offset, maps and faults it in
+    bool make_room(std::unique_lock<std::mutex>& lock, std::size_t size); ///< Switches to the spare segment unless size bytes fit in the current one, m_mutex must be held
+    void grow(); ///< Grower thread: maps the spare segment ahead of the writers and unmaps retired ones
+
+    static constexpr std::size_t s_segmentSize = 4 * 1024 * 1024; ///< File growth step, also the largest record
+
+    std::string m_path; ///< Path of the log file
+    boost::interprocess::file_mapping m_mapping; ///< File mapping of the log
+    boost::interprocess::mapped_region m_region; ///< Segment being written
+    boost::interprocess::mapped_region m_spare; ///< Next segment, mapped ahead by the grower
+    boost::interprocess::mapped_region m_retired; ///< Finished segment, unmapped by the grower
+    bool m_spareReady{ false }; ///< m_spare is mapped
+    bool m_growFailed{ false }; ///< The grower couldn't extend the file, records past the current segment are dropped
+    std::size_t m_segmentStart{ 0 }; ///< File offset of m_region
+    std::size_t m_used{ 0 }; ///< Bytes written so far (header and records), a file offset
+    std::chrono::steady_clock::time_point m_start; ///< Time origin of record offsets
+    std::mutex m_mutex; ///< Serializes appends and segment switches
+    std::condition_variable m_growCond; ///< Wakes the grower when a segment is consumed, and writers when the spare is ready
+    std::thread m_grower; ///< Thread running grow()
+    bool m_isOpen{ false }; ///< False if the log couldn't be created or was closed
+};
+
+/// @brief One record of a session log, payload points into the mapped file
+struct SessionRecord {
+    SessionRecordHeader header; ///< Time, kind and channel
+    std::string_view payload; ///< Record data, valid while the reader lives
+};
+
+/// @brief Reads a session log written by SessionRecorder
+class SessionReader {
+public:
+    SessionReader(const std::string& path); ///< Constructor for SessionReader class: maps the log read-only and checks the header
+
+    bool isOpen() const; ///< True if the file is a session log this version can read
+    const SessionLogHeader& getHeader() const; ///< Returns the log header
+
+    bool next(SessionRecord& record); ///< Reads the next record, false at the end of the log
+    void rewind(); ///< Goes back to the first record
+
+private:
+    boost::interprocess::file_mapping m_mapping; ///< File mapping of the log
+    boost::interprocess::mapped_region m_region; ///< Mapped view of the log
+    SessionLogHeader m_header{}; ///< Copy of the log header
+    std::size_t m_offset{ 0 }; ///< Offset of the next record
+    bool m_isOpen{ false }; ///< False if the file couldn't be mapped or isn't a session log
+};
+
+#endif // SESSIONRECORDER_H
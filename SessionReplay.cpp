@@ -0,0 +1,132 @@
+/**
+* @file SessionReplay.cpp
+* @author zah
+* @brief Replays a recorded session through RealTimeTranscriber and a local stand-in server
+* @version 0.1
+* @date 2024-02-02
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: SessionReplay <session.rec> <cert.pem> <key.pem> [--speed 1.0] [--port 9443] [--record replayed.rec]
+* Recorded audio is pushed into the client and recorded server messages are sent by the stand-in server,
+* each at its original offset divided by the speed. Lateness against that schedule is reported at the end.
+*/
+
+#include "RealTimeTranscriber.h"
+#include "SessionRecorder.h"
+#include "StandInServer.h"
+#include "ToolSupport.h"
+
+#include <algorithm>
+
+using namespace ChatBot;
+
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::steady_clock;
+    if (argc < 4) {
+        std::cerr << "Usage: SessionReplay <session.rec> <cert.pem> <key.pem> [--speed 1.0] [--port 9443] [--record replayed.rec]" << std::endl;
+        return 1;
+    }
+
+    const double speed = std::stod(arg_value(argc, argv, "--speed", "1.0"));
+    if (!(speed > 0.0)) {
+        // The schedule divides offsets by the speed
+        std::cerr << "Usage: SessionReplay <session.rec> <cert.pem> <key.pem> [--speed 1.0] [--port 9443] [--record replayed.rec]" << std::endl;
+        std::cerr << "--speed must be greater than 0" << std::endl;
+        return 1;
+    }
+    const unsigned short port = static_cast<unsigned short>(std::stoi(arg_value(argc, argv, "--port", "9443")));
+    const std::string recordPath = arg_value(argc, argv, "--record", "");
+
+    SessionReader reader(argv[1]);
+    if (!reader.isOpen()) {
+        return 1;
+    }
+    const SessionLogHeader& header = reader.getHeader();
+    if (header.sampleRate == 0 || header.channels == 0 || header.chunkFrames == 0) {
+        std::cerr << argv[1] << " has no sample rate, channel count or chunk size" << std::endl;
+        return 1;
+    }
+    const int channels = static_cast<int>(header.channels);
+    const int sampleRate = static_cast<int>(header.sampleRate);
+
+    // Same chunk as the recording transcriber (rounded up to whole milliseconds), so every recorded chunk can be pushed
+    const std::chrono::milliseconds chunk((static_cast<int64_t>(header.chunkFrames) * 1000 + sampleRate - 1) / sampleRate);
+
+    // The server side is scripted from the log, so no built-in replies
+    StandInServer server(port, argv[2], argv[3]);
+    server.set_auto_reply(false);
+    if (!server.start()) {
+        return 1;
+    }
+
+    RealTimeTranscriber transcriber(sampleRate, channels, paInt16, chunk);
+    transcriber.set_endpoint(server.uri());
+    transcriber.set_audio_source(AudioSource::EXTERNAL);
+    if (!recordPath.empty() && !transcriber.enable_recording(recordPath)) {
+        return 1;
+    }
+    transcriber.start_transcription();
+
+    // Schedule every record at its original offset, scaled by speed
+    int64_t originNs = 0;
+    clock::time_point base = clock::now();
+    auto scaled = [&](uint64_t offsetNs) {
+        return std::chrono::nanoseconds(static_cast<int64_t>((static_cast<int64_t>(offsetNs) - originNs) / speed));
+    };
+
+    std::chrono::nanoseconds maxLate{ 0 }, totalLate{ 0 };
+    uint64_t replayed = 0, audioDropped = 0;
+    SessionRecord record;
+    bool first = true;
+    while (reader.next(record)) {
+        if (first) {
+            originNs = static_cast<int64_t>(record.header.offsetNs);
+            first = false;
+        }
+
+        // Connection setup time differs from the recording, so re-anchor the schedule once a channel is open
+        if (record.header.kind == RecordKind::OPEN) {
+            clock::time_point deadline = clock::now() + std::chrono::seconds(10);
+            while (!transcriber.is_session_open(record.header.channel) && clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (!transcriber.is_session_open(record.header.channel)) {
+                std::cerr << "Channel " << int(record.header.channel) << " did not connect to the stand-in server" << std::endl;
+                break;
+            }
+            base = clock::now() - scaled(record.header.offsetNs);
+            continue;
+        }
+
+        clock::time_point target = base + scaled(record.header.offsetNs);
+        std::this_thread::sleep_until(target);
+        std::chrono::nanoseconds late = clock::now() - target;
+
+        switch (record.header.kind) {
+        case RecordKind::AUDIO_OUT:
+            if (!transcriber.push_audio(record.header.channel, std::vector<char>(record.payload.begin(), record.payload.end()))) {
+                audioDropped++;
+            }
+            break;
+        case RecordKind::MESSAGE_IN:
+            server.send(record.header.channel, std::string(record.payload));
+            break;
+        default:
+            continue; // Terminate and close are replayed by stopping the transcriber below
+        }
+
+        replayed++;
+        maxLate = std::max(maxLate, late);
+        totalLate += late;
+    }
+
+    transcriber.stop_transcription();
+    server.stop();
+
+    std::cout << "Replayed " << replayed << " records at " << speed << "x, "
+              << audioDropped << " audio chunks dropped, lateness mean "
+              << (replayed ? std::chrono::duration_cast<std::chrono::microseconds>(totalLate).count() / replayed : 0)
+              << " us, max " << std::chrono::duration_cast<std::chrono::microseconds>(maxLate).count() << " us" << std::endl;
+    return 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file StandInServer.cpp
+ * @author zah
+ * @brief Implementation of StandInServer class
+ * @version 0.1
+ * @date 2024-02-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "StandInServer.h"
+
+#include <charconv>
+#include <iostream>
+
+
+StandInServer::StandInServer(unsigned short port, std::string cert_file, std::string key_file)
+    : m_port(port)
+    , m_certFile(std::move(cert_file))
+    , m_keyFile(std::move(key_file))
+{
+    m_server.clear_access_channels(websocketpp::log::alevel::all);
+    m_server.set_access_channels(websocketpp::log::alevel::fail);
+    m_server.init_asio();
+    m_server.set_reuse_addr(true);
+
+    m_server.set_open_handler([this](websocketpp::connection_hdl hdl) { on_open(hdl); });
+    m_server.set_close_handler([this](websocketpp::connection_hdl hdl) { on_close(hdl); });
+    m_server.set_message_handler([this](websocketpp::connection_hdl hdl, server::message_ptr msg) { on_message(hdl, msg); });
+    m_server.set_tls_init_handler([this](websocketpp::connection_hdl hdl) { return on_tls_init(hdl); });
+}
+
+StandInServer::~StandInServer() {
+    stop();
+}
+
+bool StandInServer::start() {
+    websocketpp::lib::error_code ec;
+    m_server.listen(m_port, ec);
+    if (ec) {
+        std::cerr << "Stand-in server could not listen on port " << m_port << ": " << ec.message() << std::endl;
+        return false;
+    }
+    m_server.start_accept(ec);
+    if (ec) {
+        std::cerr << "Stand-in server could not accept: " << ec.message() << std::endl;
+        return false;
+    }
+    m_thread = std::thread([this] { m_server.run(); });
+    return true;
+}
+
+void StandInServer::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    websocketpp::lib::error_code ec;
+    m_server.stop_listening(ec);
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        for (auto& connection : m_partialCounts) {
+            m_server.close(connection.first, websocketpp::close::status::going_away, "Server stopping", ec);
+        }
+    }
+    m_server.stop();
+    m_thread.join();
+}
+
+void StandInServer::set_auto_reply(bool auto_reply) {
+    m_autoReply = auto_reply;
+}
+
+void StandInServer::set_frame_handler(frame_handler handler) {
+    m_frameHandler = std::move(handler);
+}
+
+void StandInServer::send(int channel, const std::string& payload) {
+    websocketpp::connection_hdl hdl;
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        auto it = m_channelHandles.find(channel);
+        if (it == m_channelHandles.end()) {
+            std::cerr << "Stand-in server has no connection for channel " << channel << std::endl;
+            return;
+        }
+        hdl = it->second;
+    }
+    websocketpp::lib::error_code ec;
+    m_server.send(hdl, payload, websocketpp::frame::opcode::text, ec);
+    if (ec) {
+        std::cerr << "Stand-in server send failed on channel " << channel << ": " << ec.message() << std::endl;
+    }
+}
+
+std::string StandInServer::uri() const {
+    return "wss://localhost:" + std::to_string(m_port) + "/v2/realtime/ws";
+}
+
+uint64_t StandInServer::get_frames_received() const {
+    return m_framesReceived.load();
+}
+
+uint64_t StandInServer::get_bytes_received() const {
+    return m_bytesReceived.load();
+}
+
+void StandInServer::on_open(websocketpp::connection_hdl hdl) {
+    int channel = channel_of(hdl);
+    uint64_t session;
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        m_channelHandles[channel] = hdl;
+        m_partialCounts[hdl] = 0;
+        session = m_sessionCount++;
+    }
+
+    if (m_autoReply) {
+        nlohmann::json begins{
+            {"message_type", "SessionBegins"},
+            {"session_id", "stand-in-" + std::to_string(session)},
+            {"expires_at", "2099-01-01T00:00:00.000000"},
+        };
+        websocketpp::lib::error_code ec;
+        m_server.send(hdl, begins.dump(), websocketpp::frame::opcode::text, ec);
+    }
+}
+
+void StandInServer::on_close(websocketpp::connection_hdl hdl) {
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    m_partialCounts.erase(hdl);
+}
+
+void StandInServer::on_message(websocketpp::connection_hdl hdl, server::message_ptr msg) {
+    const std::string& payload = msg->get_payload();
+    m_framesReceived++;
+    m_bytesReceived += payload.size();
+
+    if (m_frameHandler) {
+        m_frameHandler(channel_of(hdl), payload);
+    }
+    if (!m_autoReply) {
+        return;
+    }
+
+    websocketpp::lib::error_code ec;
+    nlohmann::json json_msg = nlohmann::json::parse(payload, nullptr, false);
+    if (json_msg.is_discarded()) {
+        std::cerr << "Stand-in server received a frame that isn't JSON" << std::endl;
+    }
+    else if (json_msg.contains("audio_data")) {
+        // One partial per audio frame, so clients can pair each chunk with its reply
+        uint64_t count;
+        {
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            count = ++m_partialCounts[hdl];
+        }
+        nlohmann::json partial{
+            {"message_type", "PartialTranscript"},
+            {"text", "chunk " + std::to_string(count)},
+        };
+        m_server.send(hdl, partial.dump(), websocketpp::frame::opcode::text, ec);
+    }
+    else if (json_msg.contains("terminate_session")) {
+        m_server.send(hdl, R"({"message_type":"SessionTerminated"})", websocketpp::frame::opcode::text, ec);
+        m_server.close(hdl, websocketpp::close::status::normal, "Session terminated", ec);
+    }
+}
+
+websocketpp::lib::shared_ptr<boost::asio::ssl::context> StandInServer::on_tls_init(websocketpp::connection_hdl hdl) {
+    auto ctx = websocketpp::lib::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+    try {
+        ctx->set_options(
+            boost::asio::ssl::context::default_workarounds |
+            boost::asio::ssl::context::no_sslv2 |
+            boost::asio::ssl::context::no_sslv3 |
+            boost::asio::ssl::context::single_dh_use
+        );
+        ctx->use_certificate_chain_file(m_certFile);
+        ctx->use_private_key_file(m_keyFile, boost::asio::ssl::context::pem);
+    }
+    catch (std::exception& e) {
+        std::cout << "Error in stand-in server TLS context: " << e.what() << std::endl;
+    }
+    return ctx;
+}
+
+int StandInServer::channel_of(websocketpp::connection_hdl hdl) {
+    server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+    const std::string& header = con->get_request_header("X-Channel");
+
+    // Client-supplied: anything but a whole non-negative number is channel 0, nothing may throw inside a handler
+    int channel = 0;
+    const std::from_chars_result result = std::from_chars(header.data(), header.data() + header.size(), channel);
+    if (result.ec != std::errc() || result.ptr != header.data() + header.size() || channel < 0) {
+        return 0;
+    }
+    return channel;
+}
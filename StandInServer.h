@@ -0,0 +1,77 @@
+/**
+* @file StandInServer.h
+* @author zah
+* @brief Header for StandInServer class: local TLS WebSocket server speaking enough of the real-time protocol for replay and load tests
+* @version 0.1
+* @date 2024-02-02
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef STANDINSERVER_H
+#define STANDINSERVER_H
+
+#include <nlohmann/json.hpp>
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/server.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// @brief Local stand-in for the AssemblyAI real-time endpoint
+///
+/// With auto replies on (the default) it answers like the real service would in shape, not content:
+/// SessionBegins on open, one PartialTranscript per audio frame and SessionTerminated on terminate_session.
+/// Replay turns auto replies off and scripts the server side with send().
+class StandInServer
+{
+public:
+    typedef websocketpp::server<websocketpp::config::asio_tls> server;
+    typedef std::function<void(int channel, const std::string& payload)> frame_handler; ///< Called on the server thread for every text frame a client sends
+
+    StandInServer(unsigned short port, std::string cert_file, std::string key_file); ///< Constructor for StandInServer class: sets up the endpoint, doesn't listen yet
+    ~StandInServer(); ///< Destructor for StandInServer class: stops the server
+
+    bool start(); ///< Starts listening and runs the io_service on its own thread
+    void stop(); ///< Closes every connection and stops the server thread
+
+    void set_auto_reply(bool auto_reply); ///< Enables or disables the built-in protocol replies (call before start)
+    void set_frame_handler(frame_handler handler); ///< Registers a consumer for client frames (call before start)
+
+    void send(int channel, const std::string& payload); ///< Sends a text frame to the latest connection of a channel (thread-safe)
+
+    std::string uri() const; ///< Returns the URI clients should connect to
+    uint64_t get_frames_received() const; ///< Returns the number of text frames received from all clients
+    uint64_t get_bytes_received() const; ///< Returns the number of payload bytes received from all clients
+
+private:
+    void on_open(websocketpp::connection_hdl hdl);
+    void on_close(websocketpp::connection_hdl hdl);
+    void on_message(websocketpp::connection_hdl hdl, server::message_ptr msg);
+    websocketpp::lib::shared_ptr<boost::asio::ssl::context> on_tls_init(websocketpp::connection_hdl hdl);
+
+    int channel_of(websocketpp::connection_hdl hdl); ///< Reads the channel a client connection announced (X-Channel header)
+
+    server m_server; ///< WebSocket server endpoint
+    std::thread m_thread; ///< Thread running the server's io_service
+    const unsigned short m_port; ///< Port to listen on (localhost)
+    const std::string m_certFile; ///< PEM certificate chain
+    const std::string m_keyFile; ///< PEM private key
+    bool m_autoReply{ true }; ///< Answer protocol messages without a script
+    frame_handler m_frameHandler; ///< Consumer of client frames
+
+    std::mutex m_connectionsMutex; ///< Mutex for protecting connection bookkeeping
+    std::map<int, websocketpp::connection_hdl> m_channelHandles; ///< Latest connection of each channel
+    std::map<websocketpp::connection_hdl, uint64_t, std::owner_less<websocketpp::connection_hdl>> m_partialCounts; ///< Auto-reply partials sent per connection
+    uint64_t m_sessionCount{ 0 }; ///< Sessions opened, used for session ids
+
+    std::atomic<uint64_t> m_framesReceived{ 0 }; ///< Text frames received
+    std::atomic<uint64_t> m_bytesReceived{ 0 }; ///< Payload bytes received
+};
+
+#endif // STANDINSERVER_H
@@ -21,6 +21,8 @@ StreamPy::StreamPy(CallbackHandler* callbackHandler)
     , m_sampleRate(16'000)
     , m_isTranscribing(false)
     , m_callbackHandler(callbackHandler) 
+    , m_audio(AudioRuntime::acquire())
+    , m_micStream(nullptr)
     , m_stopThread(false)
 {
     py::initialize_interpreter();
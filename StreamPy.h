@@ -58,6 +58,7 @@ private:
 	py::object m_pyCallbackHandler; ///< Python callback handler object 
 
 	// Microphone stream objects
+	std::shared_ptr<AudioRuntime> m_audio; ///< Keeps PortAudio, its device list and idle streams alive across start/stop cycles
 	MicrophoneStream* m_micStream; ///< C++ microphone stream object
 
 	// C++ threading objects
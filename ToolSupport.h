@@ -0,0 +1,55 @@
+/**
+* @file ToolSupport.h
+* @author zah
+* @brief Command line and reporting helpers shared by the benchmark, replay and load tools
+* @version 0.1
+* @date 2024-03-20
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef TOOLSUPPORT_H
+#define TOOLSUPPORT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/// @brief Discards console output of the code under test
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/// @brief Value following an option (--name value), fallback if the option is absent
+inline std::string arg_value(int argc, char* argv[], const std::string& name, const std::string& fallback) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (name == argv[i]) {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+/// @brief True if a flag without a value (--name) is present
+inline bool has_flag(int argc, char* argv[], const std::string& name) {
+    for (int i = 1; i < argc; ++i) {
+        if (name == argv[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Nearest-rank percentile of sorted samples, p from 0 to 1, 0 if there are none
+inline int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))];
+}
+
+#endif // TOOLSUPPORT_H
@@ -0,0 +1,321 @@
+/**
+ * @file TranscriptChannel.cpp
+ * @author zah
+ * @brief Implementation of TranscriptPublisher and TranscriptSubscriber classes
+ * @version 0.1
+ * @date 2024-03-22
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "TranscriptChannel.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSCRIPT_CHANNEL_PAUSE() _mm_pause()
+#else
+#define TRANSCRIPT_CHANNEL_PAUSE() std::this_thread::yield()
+#endif
+
+namespace bip = boost::interprocess;
+
+static_assert(sizeof(TranscriptSlotHeader) == 40, "Transcript slot header must stay 40 bytes");
+
+namespace {
+    const char s_magic[8] = { 'A', 'A', 'I', 'T', 'X', 'T', '\0', '\1' };
+
+    uint32_t header_bytes() {
+        return static_cast<uint32_t>((sizeof(TranscriptChannelHeader) + 63) & ~std::size_t(63));
+    }
+} // namespace
+
+
+TranscriptPublisher::TranscriptPublisher(const std::string& name, uint32_t slotCount, uint32_t slotBytes)
+    : m_name(name)
+    , m_slotCount(std::max<uint32_t>(slotCount, 1))
+    , m_slotBytes((std::max<uint32_t>(slotBytes, sizeof(TranscriptSlotHeader) + 8) + 63) & ~uint32_t(63))
+{
+    // A segment left by a publisher that crashed is replaced, its readers see a fresh createdEpochNs
+    try {
+        bip::shared_memory_object::remove(m_name.c_str());
+        m_shm = bip::shared_memory_object(bip::create_only, m_name.c_str(), bip::read_write);
+        m_shm.truncate(static_cast<bip::offset_t>(header_bytes()) + static_cast<bip::offset_t>(m_slotCount) * m_slotBytes);
+        m_region = bip::mapped_region(m_shm, bip::read_write);
+    }
+    catch (const bip::interprocess_exception& e) {
+        std::cerr << "Transcript channel could not create " << m_name << ": " << e.what() << std::endl;
+        return;
+    }
+
+    char* base = static_cast<char*>(m_region.get_address());
+    m_header = new (base) TranscriptChannelHeader();
+    m_header->version = s_version;
+    m_header->headerBytes = header_bytes();
+    m_header->slotCount = m_slotCount;
+    m_header->slotBytes = m_slotBytes;
+    m_header->createdEpochNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_slots = base + m_header->headerBytes;
+    for (uint32_t i = 0; i < m_slotCount; ++i) {
+        new (m_slots + static_cast<std::size_t>(i) * m_slotBytes) TranscriptSlotHeader();
+    }
+
+    // The magic goes in last, readers that attach earlier see an unfinished segment and retry
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_header->magic, s_magic, sizeof(m_header->magic));
+    m_isOpen = true;
+}
+
+TranscriptPublisher::~TranscriptPublisher() {
+    close();
+}
+
+bool TranscriptPublisher::isOpen() const {
+    return m_isOpen;
+}
+
+void TranscriptPublisher::publish(int channel, const TranscriptDelta& delta, std::string_view text) {
+    if (!m_isOpen) {
+        return;
+    }
+
+    // Cut long texts on a UTF-8 character boundary
+    const std::size_t capacity = m_slotBytes - sizeof(TranscriptSlotHeader);
+    std::size_t length = text.size();
+    if (length > capacity) {
+        length = capacity;
+        while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+            --length;
+        }
+    }
+
+    const uint64_t sequence = m_published;
+    TranscriptSlotHeader* out = slot(sequence);
+    out->sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // Readers see the odd sequence before any new byte
+    out->timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    out->revision = delta.revision;
+    out->stablePrefix = static_cast<uint32_t>(std::min(delta.stablePrefix, length));
+    out->textLength = static_cast<uint32_t>(length);
+    out->channel = static_cast<uint16_t>(channel);
+    out->kind = delta.isFinal ? TranscriptKind::FINAL : TranscriptKind::PARTIAL;
+    out->truncated = length < text.size() ? 1 : 0;
+    std::memcpy(reinterpret_cast<char*>(out) + sizeof(TranscriptSlotHeader), text.data(), length);
+    out->sequence.store(2 * sequence + 2, std::memory_order_release);
+
+    // Spinning readers see the count; blocked readers register first, so the semaphore is only posted when one waits
+    m_published = sequence + 1;
+    m_header->published.store(m_published, std::memory_order_seq_cst);
+    wake_readers();
+}
+
+uint64_t TranscriptPublisher::getPublished() const {
+    return m_published;
+}
+
+void TranscriptPublisher::close() {
+    if (!m_isOpen) {
+        return;
+    }
+    m_isOpen = false;
+
+    m_header->closed.store(1, std::memory_order_seq_cst);
+    wake_readers();
+    bip::shared_memory_object::remove(m_name.c_str()); // Readers already attached keep their mapping
+}
+
+void TranscriptPublisher::wake_readers() {
+    // One post per blocked reader, minus posts still waiting to be taken. A reader killed while waiting leaves its
+    // count behind; the posts for it stay untaken, so they aren't repeated on every event and the semaphore's
+    // count stays at most the waiter count. Live readers take them as spurious wake-ups and wait again.
+    const uint32_t waiters = m_header->waiters.load(std::memory_order_seq_cst);
+    const uint32_t pending = m_header->pendingWakeups.load(std::memory_order_seq_cst);
+    const uint32_t posts = waiters > pending ? std::min(waiters - pending, s_maxWakeups) : 0;
+    m_header->pendingWakeups.fetch_add(posts, std::memory_order_seq_cst);
+    for (uint32_t i = 0; i < posts; ++i) {
+        try {
+            m_header->wakeups.post();
+        }
+        catch (const bip::interprocess_exception& e) {
+            // Readers still wake up at their timeout
+            m_header->pendingWakeups.fetch_sub(posts - i, std::memory_order_seq_cst);
+            std::cerr << "Transcript channel could not wake readers: " << e.what() << std::endl;
+            return;
+        }
+    }
+}
+
+TranscriptSlotHeader* TranscriptPublisher::slot(uint64_t sequence) {
+    return reinterpret_cast<TranscriptSlotHeader*>(m_slots + (sequence % m_slotCount) * m_slotBytes);
+}
+
+
+TranscriptSubscriber::TranscriptSubscriber(const std::string& name, bool from_oldest)
+    : m_name(name)
+{
+    try {
+        m_shm = bip::shared_memory_object(bip::open_only, name.c_str(), bip::read_write);
+        m_region = bip::mapped_region(m_shm, bip::read_write);
+    }
+    catch (const bip::interprocess_exception& e) {
+        std::cerr << "Transcript channel could not open " << name << ": " << e.what() << std::endl;
+        return;
+    }
+
+    char* base = static_cast<char*>(m_region.get_address());
+    m_header = reinterpret_cast<TranscriptChannelHeader*>(base);
+    if (m_region.get_size() < sizeof(TranscriptChannelHeader) || std::memcmp(m_header->magic, s_magic, sizeof(s_magic)) != 0) {
+        std::cerr << "Transcript channel " << name << " isn't ready or isn't a transcript channel" << std::endl;
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_header->version != TranscriptPublisher::s_version) {
+        std::cerr << "Transcript channel " << name << " has version " << m_header->version << ", expected " << TranscriptPublisher::s_version << std::endl;
+        return;
+    }
+    m_slotCount = m_header->slotCount;
+    m_slotBytes = m_header->slotBytes;
+    if (m_region.get_size() < m_header->headerBytes + static_cast<std::size_t>(m_slotCount) * m_slotBytes) {
+        std::cerr << "Transcript channel " << name << " is smaller than its header says" << std::endl;
+        return;
+    }
+    m_slots = base + m_header->headerBytes;
+
+    const uint64_t published = m_header->published.load(std::memory_order_acquire);
+    m_cursor = published;
+    if (from_oldest) {
+        m_cursor = published > m_slotCount ? published - m_slotCount : 0;
+    }
+    m_isOpen = true;
+}
+
+bool TranscriptSubscriber::isOpen() const {
+    return m_isOpen;
+}
+
+bool TranscriptSubscriber::isClosed() const {
+    return !m_isOpen || m_header->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool TranscriptSubscriber::isReplaced() const {
+    if (!m_isOpen) {
+        return false;
+    }
+    // Only the header is mapped, and a segment being created (no magic yet) doesn't count until it's finished
+    try {
+        bip::shared_memory_object shm(bip::open_only, m_name.c_str(), bip::read_only);
+        bip::mapped_region region(shm, bip::read_only, 0, sizeof(TranscriptChannelHeader));
+        const auto* header = static_cast<const TranscriptChannelHeader*>(region.get_address());
+        if (std::memcmp(header->magic, s_magic, sizeof(s_magic)) != 0) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header->createdEpochNs != m_header->createdEpochNs;
+    }
+    catch (const bip::interprocess_exception&) {
+        return false; // No segment under the name: closed, or a publisher is between removing and creating it
+    }
+}
+
+bool TranscriptSubscriber::next(TranscriptEvent& event) {
+    if (!m_isOpen) {
+        return false;
+    }
+    for (;;) {
+        const uint64_t published = m_header->published.load(std::memory_order_acquire);
+        if (m_cursor >= published) {
+            return false;
+        }
+        // Lapped: what's older than the ring is gone
+        if (published - m_cursor > m_slotCount) {
+            m_missed += published - m_slotCount - m_cursor;
+            m_cursor = published - m_slotCount;
+        }
+
+        const TranscriptSlotHeader* in = slot(m_cursor);
+        const uint64_t expected = 2 * m_cursor + 2;
+        if (in->sequence.load(std::memory_order_acquire) == expected) {
+            event.sequence = m_cursor;
+            event.timestampNs = in->timestampNs;
+            event.revision = in->revision;
+            event.channel = in->channel;
+            event.kind = in->kind;
+            event.truncated = in->truncated != 0;
+            event.stablePrefix = in->stablePrefix;
+            event.text = std::string_view(reinterpret_cast<const char*>(in) + sizeof(TranscriptSlotHeader), std::min<std::size_t>(in->textLength, m_slotBytes - sizeof(TranscriptSlotHeader)));
+
+            // The fields are only good if the writer didn't start on the slot meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (in->sequence.load(std::memory_order_relaxed) == expected) {
+                m_cursor++;
+                return true;
+            }
+        }
+        // Overwritten since the count was read, skip it
+        m_missed++;
+        m_cursor++;
+    }
+}
+
+bool TranscriptSubscriber::isValid(const TranscriptEvent& event) const {
+    if (!m_isOpen) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot(event.sequence)->sequence.load(std::memory_order_relaxed) == 2 * event.sequence + 2;
+}
+
+bool TranscriptSubscriber::wait(std::chrono::microseconds timeout, std::chrono::microseconds spin) {
+    if (!m_isOpen) {
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto spinUntil = start + std::min(spin, timeout);
+    while (!available()) {
+        if (std::chrono::steady_clock::now() >= spinUntil) {
+            break;
+        }
+        TRANSCRIPT_CHANNEL_PAUSE();
+    }
+    if (available()) {
+        return true;
+    }
+
+    // Register as a waiter before the last check, so the writer either sees us or we see its event
+    const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(timeout - (std::chrono::steady_clock::now() - start));
+    const boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::microseconds(std::max<int64_t>(0, remaining.count()));
+    m_header->waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (!available()) {
+        if (!m_header->wakeups.timed_wait(deadline)) {
+            break;
+        }
+        // Taken before checking again: a writer that still counted this post has published what it posted for
+        m_header->pendingWakeups.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    m_header->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    return available();
+}
+
+uint64_t TranscriptSubscriber::getMissed() const {
+    return m_missed;
+}
+
+uint64_t TranscriptSubscriber::getCreatedEpochNs() const {
+    return m_isOpen ? m_header->createdEpochNs : 0;
+}
+
+const TranscriptSlotHeader* TranscriptSubscriber::slot(uint64_t sequence) const {
+    return reinterpret_cast<const TranscriptSlotHeader*>(m_slots + (sequence % m_slotCount) * m_slotBytes);
+}
+
+bool TranscriptSubscriber::available() const {
+    return m_header->published.load(std::memory_order_seq_cst) > m_cursor || m_header->closed.load(std::memory_order_acquire) != 0;
+}
@@ -0,0 +1,165 @@
+/**
+* @file TranscriptChannel.h
+* @author zah
+* @brief Header for TranscriptPublisher and TranscriptSubscriber classes: transcript events in a shared-memory ring for local processes
+* @version 0.1
+* @date 2024-03-22
+*
+* @copyright Copyright (c) 2024
+*
+* Layout of the shared-memory segment (native endianness, one machine):
+*   header : char magic[8] "AAITXT\0\1", uint32 version, uint32 headerBytes, uint32 slotCount, uint32 slotBytes, uint64 createdEpochNs,
+*            then on their own cache lines the published event count, the closed flag, and the waiter count and
+*            untaken post count with the process-shared semaphore blocking readers wait on
+*   slots  : slotCount slots of slotBytes each, a TranscriptSlotHeader followed by the UTF-8 text
+* Event n goes to slot n % slotCount. The slot's sequence is 2n+1 while it is written and 2n+2 once it is complete,
+* so readers detect events that were overwritten while they read them (a per-slot seqlock). There is one writer;
+* readers never write to the ring and don't slow the writer down, a reader that falls behind by more than the ring
+* skips what it missed. A publisher that crashes never sets the closed flag; readers find out when a restarted
+* publisher replaces the segment under the same name (TranscriptSubscriber::isReplaced).
+*/
+#ifndef TRANSCRIPTCHANNEL_H
+#define TRANSCRIPTCHANNEL_H
+
+#include "TranscriptDiff.h"
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_semaphore.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the transcript ring needs lock-free 64-bit atomics to be shared between processes");
+
+/// @brief What a transcript event carries
+enum class TranscriptKind : uint8_t {
+    PARTIAL = 1, ///< Partial transcript, the utterance is still going on
+    FINAL = 2,   ///< Final transcript, closes the utterance
+};
+
+/// @brief Header at the start of the shared-memory segment
+struct TranscriptChannelHeader {
+    char magic[8]; ///< "AAITXT\0\1"
+    uint32_t version; ///< Layout version, see TranscriptPublisher::s_version
+    uint32_t headerBytes; ///< Offset of the first slot
+    uint32_t slotCount; ///< Slots in the ring
+    uint32_t slotBytes; ///< Bytes per slot, header and text
+    uint64_t createdEpochNs; ///< Wall clock time the publisher created the segment, tells restarted publishers apart
+
+    alignas(64) std::atomic<uint64_t> published; ///< Events published so far, stored after the event is complete
+    std::atomic<uint32_t> closed; ///< Non-zero once the publisher is gone
+
+    alignas(64) std::atomic<uint32_t> waiters; ///< Readers blocked on the semaphore, the writer only posts when there are some
+    std::atomic<uint32_t> pendingWakeups; ///< Posts no reader has taken yet, the writer keeps it at most waiters
+    boost::interprocess::interprocess_semaphore wakeups{ 0 }; ///< Posted once per waiting reader when events are published, the writer never waits on it
+};
+
+/// @brief Fixed part of a slot, the text follows
+struct TranscriptSlotHeader {
+    std::atomic<uint64_t> sequence; ///< 2n+1 while event n is written, 2n+2 once it is complete
+    uint64_t timestampNs; ///< steady_clock time the event was published, comparable between processes of the machine
+    uint64_t revision; ///< TranscriptDelta revision
+    uint32_t stablePrefix; ///< Bytes of text unchanged since the previous transcript of the utterance
+    uint32_t textLength; ///< Bytes of text in the slot
+    uint16_t channel; ///< Channel session the transcript belongs to
+    TranscriptKind kind; ///< Partial or final
+    uint8_t truncated; ///< Non-zero if the text didn't fit the slot
+    uint32_t reserved; ///< Zero
+};
+
+/// @brief One transcript event, text points into shared memory
+///
+/// Nothing is copied: the view stays readable until the publisher has written slotCount more events.
+/// TranscriptSubscriber::isValid tells whether that happened while the event was used.
+struct TranscriptEvent {
+    uint64_t sequence{ 0 }; ///< Event number, from 0 since the publisher started
+    uint64_t timestampNs{ 0 }; ///< steady_clock time of publication, in nanoseconds
+    uint64_t revision{ 0 }; ///< TranscriptDelta revision
+    int channel{ 0 }; ///< Channel session
+    TranscriptKind kind{ TranscriptKind::PARTIAL }; ///< Partial or final
+    bool truncated{ false }; ///< The text was cut to fit the slot
+    std::size_t stablePrefix{ 0 }; ///< Bytes of text unchanged since the previous transcript of the utterance
+    std::string_view text; ///< Whole transcript of the utterance so far
+};
+
+/// @brief Writes transcript events into a named shared-memory ring
+///
+/// Publishing is a memcpy and two atomic stores, plus semaphore posts only while some reader is blocked waiting.
+/// Nothing a reader does (or a reader dying at any point) can block it. Single writer: RealTimeTranscriber
+/// publishes from its WebSocket thread.
+class TranscriptPublisher {
+public:
+    /// @brief Creates (or replaces) the segment, slotBytes is rounded up to a multiple of 64
+    TranscriptPublisher(const std::string& name, uint32_t slotCount = 1024, uint32_t slotBytes = 512);
+    ~TranscriptPublisher(); ///< Marks the channel closed and removes its name, mapped readers keep their view
+
+    bool isOpen() const; ///< True if the segment could be created and mapped
+
+    void publish(int channel, const TranscriptDelta& delta, std::string_view text); ///< Writes one event and wakes blocked readers
+    uint64_t getPublished() const; ///< Events published so far
+
+    void close(); ///< Marks the channel closed and wakes every reader, later events are dropped
+
+    static constexpr uint32_t s_version = 3; ///< Current layout version (2: semaphore instead of mutex and condition, 3: untaken post count)
+    static constexpr uint32_t s_maxWakeups = 64; ///< Posts per event at most, bounds the cost of waiter counts left by killed readers
+
+private:
+    TranscriptSlotHeader* slot(uint64_t sequence); ///< Slot of an event
+    void wake_readers(); ///< Posts the semaphore for every blocked reader without an untaken post, never waits
+
+    std::string m_name; ///< Shared-memory object name
+    boost::interprocess::shared_memory_object m_shm; ///< Shared-memory object
+    boost::interprocess::mapped_region m_region; ///< Mapping of the whole segment
+    TranscriptChannelHeader* m_header{ nullptr }; ///< Segment header
+    char* m_slots{ nullptr }; ///< First slot
+    uint32_t m_slotCount{ 0 }; ///< Slots in the ring
+    uint32_t m_slotBytes{ 0 }; ///< Bytes per slot
+    uint64_t m_published{ 0 }; ///< Writer's copy of the published count
+    bool m_isOpen{ false }; ///< False if the segment couldn't be created or was closed
+};
+
+/// @brief Reads transcript events from a publisher's ring, each subscriber with its own cursor
+class TranscriptSubscriber {
+public:
+    /// @brief Attaches to a publisher's segment, from its next event or from the oldest it still holds
+    TranscriptSubscriber(const std::string& name, bool from_oldest = false);
+
+    bool isOpen() const; ///< True if the segment exists and has a layout this version reads
+    bool isClosed() const; ///< True once the publisher has closed the channel
+    bool isReplaced() const; ///< True if the name now holds another publisher's segment, e.g. after this one's publisher crashed (opens the name, not for every event)
+
+    bool next(TranscriptEvent& event); ///< Takes the next event without waiting, false if there is none yet
+    bool isValid(const TranscriptEvent& event) const; ///< True if the event's slot wasn't overwritten since next returned it
+
+    /// @brief Waits until an event is available or the channel closes
+    ///
+    /// Spins on the published count first, which notices an event within a fraction of a microsecond,
+    /// then blocks on the process-shared semaphore, which costs a wake-up but no CPU.
+    /// @return False on timeout
+    bool wait(std::chrono::microseconds timeout, std::chrono::microseconds spin = std::chrono::microseconds(50));
+
+    uint64_t getMissed() const; ///< Events overwritten before this subscriber read them
+    uint64_t getCreatedEpochNs() const; ///< When the publisher created the segment, tells a restarted publisher's segment apart
+
+private:
+    const TranscriptSlotHeader* slot(uint64_t sequence) const; ///< Slot of an event
+    bool available() const; ///< True if an event is waiting or the channel is closed
+
+    std::string m_name; ///< Shared-memory object name
+    boost::interprocess::shared_memory_object m_shm; ///< Shared-memory object
+    boost::interprocess::mapped_region m_region; ///< Mapping of the whole segment
+    TranscriptChannelHeader* m_header{ nullptr }; ///< Segment header (writable: waiter count and semaphore)
+    const char* m_slots{ nullptr }; ///< First slot
+    uint32_t m_slotCount{ 0 }; ///< Slots in the ring
+    uint32_t m_slotBytes{ 0 }; ///< Bytes per slot
+    uint64_t m_cursor{ 0 }; ///< Next event to read
+    uint64_t m_missed{ 0 }; ///< Events skipped because the ring wrapped
+    bool m_isOpen{ false }; ///< False if the segment couldn't be opened or has another layout
+};
+
+#endif // TRANSCRIPTCHANNEL_H
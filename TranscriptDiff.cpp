@@ -0,0 +1,66 @@
+/**
+ * @file TranscriptDiff.cpp
+ * @author zah
+ * @brief Implementation of TranscriptDiffer class
+ * @version 0.1
+ * @date 2024-01-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "TranscriptDiff.h"
+
+#include <algorithm>
+
+
+TranscriptDiffer::TranscriptDiffer() {
+    m_text.reserve(512); // A few sentences, grows if an utterance is longer
+}
+
+const TranscriptDelta& TranscriptDiffer::update(std::string_view text, bool isFinal) {
+    // The update after a final starts a new utterance
+    std::string_view previous = m_delta.isFinal ? std::string_view() : std::string_view(m_text);
+
+    // Longest common prefix, then back off to the start of the word it ends in
+    std::size_t common = std::mismatch(previous.begin(), previous.begin() + std::min(previous.size(), text.size()), text.begin()).first - previous.begin();
+    common = wordAlign(previous, text, common);
+
+    m_delta.revision++;
+    m_delta.stablePrefix = common;
+    m_delta.removed = previous.size() - common;
+    m_delta.isFinal = isFinal;
+
+    // Only the changed tail is rewritten
+    m_text.replace(common, std::string::npos, text.substr(common));
+    m_delta.suffix = std::string_view(m_text).substr(common);
+
+    return m_delta;
+}
+
+void TranscriptDiffer::reset() {
+    m_text.clear();
+    m_delta.stablePrefix = 0;
+    m_delta.removed = 0;
+    m_delta.suffix = std::string_view();
+    m_delta.isFinal = false;
+}
+
+const TranscriptDelta& TranscriptDiffer::getDelta() const {
+    return m_delta;
+}
+
+const std::string& TranscriptDiffer::getText() const {
+    return m_text;
+}
+
+std::size_t TranscriptDiffer::wordAlign(std::string_view previous, std::string_view next, std::size_t common) {
+    auto atBoundary = [](std::string_view s, std::size_t i) { return i == s.size() || s[i] == ' '; };
+
+    // The prefix is word-aligned if it ends after a space or if neither text continues the word
+    if (common == 0 || next[common - 1] == ' ' || (atBoundary(previous, common) && atBoundary(next, common))) {
+        return common;
+    }
+
+    std::size_t space = next.rfind(' ', common - 1);
+    return space == std::string_view::npos ? 0 : space + 1;
+}
@@ -0,0 +1,50 @@
+/**
+* @file TranscriptDiff.h
+* @author zah
+* @brief Header for TranscriptDiffer class that turns consecutive transcripts into word-aligned deltas
+* @version 0.1
+* @date 2024-01-12
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef TRANSCRIPTDIFF_H
+#define TRANSCRIPTDIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// @brief Change between two consecutive transcripts of the same utterance
+struct TranscriptDelta {
+    uint64_t revision{ 0 };        ///< Incremented on every update, never reset
+    std::size_t stablePrefix{ 0 }; ///< Number of bytes at the start of the text that did not change (word-aligned)
+    std::size_t removed{ 0 };      ///< Number of bytes of the previous text to drop after the stable prefix
+    std::string_view suffix;       ///< Replacement text after the stable prefix (valid until the next update)
+    bool isFinal{ false };         ///< True if this update closes the utterance
+};
+
+/// @brief Computes stable-prefix / changed-suffix deltas between consecutive partial transcripts
+///
+/// Every partial transcript carries the whole utterance so far. Consumers that only apply the
+/// delta (erase `removed` bytes after `stablePrefix`, then append `suffix`) do work proportional
+/// to what changed rather than to the utterance length.
+class TranscriptDiffer {
+public:
+    TranscriptDiffer(); ///< Constructor for TranscriptDiffer class: reserves the text buffer
+
+    const TranscriptDelta& update(std::string_view text, bool isFinal); ///< Diffs text against the previous update and returns the delta (a final closes the utterance)
+    void reset(); ///< Forgets the current utterance (revision keeps counting)
+
+    const TranscriptDelta& getDelta() const; ///< Returns the last computed delta
+    const std::string& getText() const; ///< Returns the full text of the current utterance
+
+private:
+    static std::size_t wordAlign(std::string_view previous, std::string_view next, std::size_t common); ///< Moves a common prefix length back to a word boundary
+
+    std::string m_text; ///< Text of the current utterance (last update)
+    TranscriptDelta m_delta; ///< Last computed delta, suffix points into m_text
+};
+
+#endif // TRANSCRIPTDIFF_H
@@ -0,0 +1,88 @@
+/**
+* @file TranscriptTail.cpp
+* @author zah
+* @brief Follows a transcript channel from another process and prints its events
+* @version 0.1
+* @date 2024-03-22
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: TranscriptTail <channel name> [--from-oldest] [--spin-us 50]
+* Reference reader for the shared-memory transcript channel: waits for events, prints each one with the time it
+* took from publication to this process, and reports events it missed because it fell a whole ring behind. When the
+* publisher closes the channel it waits for a restarted publisher (a segment with another createdEpochNs) and follows it.
+* A publisher that crashed never closes the channel, so while no events come the name is checked once a second for a
+* restarted publisher's segment.
+*/
+
+#include "ToolSupport.h"
+#include "TranscriptChannel.h"
+
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace {
+    /// @brief Polls until a publisher's segment other than the closed one (created at closedEpochNs) can be read
+    std::unique_ptr<TranscriptSubscriber> attach(const std::string& name, bool from_oldest, uint64_t closedEpochNs, int attempts) {
+        NullBuffer nullBuffer;
+        for (int attempt = 0; attempts == 0 || attempt < attempts; ++attempt) {
+            std::streambuf* console = std::cerr.rdbuf(attempt > 0 ? &nullBuffer : std::cerr.rdbuf()); // Report the first failure only
+            auto subscriber = std::make_unique<TranscriptSubscriber>(name, from_oldest);
+            std::cerr.rdbuf(console);
+            if (subscriber->isOpen() && subscriber->getCreatedEpochNs() != closedEpochNs) {
+                return subscriber;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return nullptr;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: TranscriptTail <channel name> [--from-oldest] [--spin-us 50]" << std::endl;
+        return 1;
+    }
+    const std::chrono::microseconds spin(std::stoi(arg_value(argc, argv, "--spin-us", "50")));
+
+    // The publisher may not be up yet
+    std::unique_ptr<TranscriptSubscriber> subscriber = attach(argv[1], has_flag(argc, argv, "--from-oldest"), 0, 100);
+    if (!subscriber) {
+        return 1;
+    }
+
+    uint64_t missed = 0;
+    TranscriptEvent event;
+    while (true) {
+        if (subscriber->isClosed()) {
+            // A restarted publisher creates a new segment; read it from its first event
+            std::cerr << "Transcript channel closed, waiting for the publisher to restart" << std::endl;
+            subscriber = attach(argv[1], true, subscriber->getCreatedEpochNs(), 0);
+            missed = 0;
+            std::cerr << "Transcript channel reopened" << std::endl;
+        }
+        if (!subscriber->wait(std::chrono::seconds(1), spin)) {
+            if (subscriber->isReplaced()) {
+                // The publisher crashed (never closed the channel) and a new one took the name over
+                std::cerr << "Transcript channel replaced by a restarted publisher" << std::endl;
+                subscriber = attach(argv[1], true, subscriber->getCreatedEpochNs(), 0);
+                missed = 0;
+            }
+            continue;
+        }
+        while (subscriber->next(event)) {
+            const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            std::cout << "[ch " << event.channel << "] " << (event.kind == TranscriptKind::FINAL ? "final  " : "partial") << " r" << event.revision
+                      << " (+" << (now - static_cast<int64_t>(event.timestampNs)) / 1000.0 << " us): " << event.text;
+            if (!subscriber->isValid(event)) {
+                std::cout << " [overwritten while printing]";
+            }
+            std::cout << std::endl;
+        }
+        if (subscriber->getMissed() != missed) {
+            std::cerr << "Missed " << subscriber->getMissed() - missed << " events" << std::endl;
+            missed = subscriber->getMissed();
+        }
+    }
+}
@@ -0,0 +1,203 @@
+/**
+* @file TransportBench.cpp
+* @author zah
+* @brief Compares transport profiles end to end against the local TLS stand-in server
+* @version 0.1
+* @date 2024-02-23
+*
+* @copyright Copyright (c) 2024
+*
+* Usage: TransportBench <cert.pem> <key.pem> [--chunks 2000] [--interval-us 2000] [--port 9444] [--profile name] [--out transport.json]
+* For each profile, 200 ms PCM16 chunks are pushed into a RealTimeTranscriber at a fixed interval and timed until the
+* stand-in server has read the frame: per-chunk send latency (queue, framing, TLS, loopback) and process CPU time per
+* megabyte of encrypted frames. Client and server share the process, so CPU covers both ends of the TLS session.
+*/
+
+#include "RealTimeTranscriber.h"
+#include "StandInServer.h"
+#include "ToolSupport.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+
+using namespace ChatBot;
+
+namespace {
+    /// @brief Push times of chunks the server hasn't read yet, and the latencies of those it has
+    struct LatencyTracker {
+        std::mutex mutex;
+        std::deque<std::chrono::steady_clock::time_point> pending;
+        std::vector<int64_t> latenciesNs;
+    };
+
+    std::vector<TransportProfile> make_profiles() {
+        std::vector<TransportProfile> profiles;
+        profiles.push_back(TransportProfile::untuned());
+        profiles.push_back(TransportProfile{}); // low_latency: NODELAY, keep-alive, TLS 1.3, AEAD picked for the CPU
+
+        TransportProfile aes;
+        aes.name = "aes_gcm_only";
+        aes.cipherPreference = CipherPreference::AES_GCM;
+        aes.cipherOnly = true;
+        profiles.push_back(aes);
+
+        TransportProfile chacha;
+        chacha.name = "chacha20_only";
+        chacha.cipherPreference = CipherPreference::CHACHA20;
+        chacha.cipherOnly = true;
+        profiles.push_back(chacha);
+
+        TransportProfile buffers;
+        buffers.name = "large_buffers";
+        buffers.sendBufferBytes = 1 << 20;
+        buffers.receiveBufferBytes = 1 << 20;
+        profiles.push_back(buffers);
+        return profiles;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::steady_clock;
+    if (argc < 3) {
+        std::cerr << "Usage: TransportBench <cert.pem> <key.pem> [--chunks 2000] [--interval-us 2000] [--port 9444] [--profile name] [--out transport.json]" << std::endl;
+        return 1;
+    }
+
+    const int SAMPLE_RATE = 16000;
+    const int FRAMES_PER_BUFFER = static_cast<int>(SAMPLE_RATE * 0.2); // Same chunk as RealTimeTranscriber
+    const int chunks = std::stoi(arg_value(argc, argv, "--chunks", "2000"));
+    const std::chrono::microseconds interval(std::stoi(arg_value(argc, argv, "--interval-us", "2000")));
+    const unsigned short port = static_cast<unsigned short>(std::stoi(arg_value(argc, argv, "--port", "9444")));
+    const std::string only = arg_value(argc, argv, "--profile", "");
+    const std::string outPath = arg_value(argc, argv, "--out", "");
+
+    std::vector<char> pcm(FRAMES_PER_BUFFER * sizeof(int16_t));
+    for (std::size_t i = 0; i < pcm.size(); ++i) {
+        pcm[i] = static_cast<char>((i * 7919) >> 3); // Deterministic noise
+    }
+
+    // Pure transport: no scripted or automatic replies, audio frames are only timed
+    LatencyTracker tracker;
+    StandInServer server(port, argv[1], argv[2]);
+    server.set_auto_reply(false);
+    server.set_frame_handler([&tracker](int, const std::string& payload) {
+        if (payload.compare(0, 14, "{\"audio_data\":") != 0) {
+            return;
+        }
+        clock::time_point now = clock::now();
+        std::lock_guard<std::mutex> lock(tracker.mutex);
+        if (!tracker.pending.empty()) {
+            tracker.latenciesNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - tracker.pending.front()).count());
+            tracker.pending.pop_front();
+        }
+    });
+    if (!server.start()) {
+        return 1;
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+    // One transcriber for every profile: each profile after the first also checks that a stopped transcriber reconnects
+    RealTimeTranscriber transcriber(SAMPLE_RATE);
+    transcriber.set_endpoint(server.uri());
+    transcriber.set_audio_source(AudioSource::EXTERNAL);
+
+    nlohmann::json results = nlohmann::json::array();
+    for (const TransportProfile& profile : make_profiles()) {
+        if (!only.empty() && profile.name != only) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(tracker.mutex);
+            tracker.pending.clear();
+            tracker.latenciesNs.clear();
+            tracker.latenciesNs.reserve(chunks);
+        }
+
+        transcriber.set_transport_profile(profile);
+        transcriber.start_transcription();
+
+        clock::time_point deadline = clock::now() + std::chrono::seconds(10);
+        while (!transcriber.is_session_open(0) && clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!transcriber.is_session_open(0)) {
+            std::cerr << "Profile " << profile.name << " did not connect to the stand-in server" << std::endl;
+            transcriber.stop_transcription();
+            continue;
+        }
+
+        // Paced pushes, each one timed until the server has decrypted and read it
+        const uint64_t bytesBefore = server.get_bytes_received();
+        const std::clock_t cpuStart = std::clock();
+        clock::time_point next = clock::now();
+        int dropped = 0;
+        for (int i = 0; i < chunks; ++i) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+            std::lock_guard<std::mutex> lock(tracker.mutex);
+            tracker.pending.push_back(clock::now());
+            if (!transcriber.push_audio(0, pcm)) {
+                tracker.pending.pop_back();
+                dropped++;
+            }
+        }
+        deadline = clock::now() + std::chrono::seconds(10);
+        while (clock::now() < deadline) {
+            {
+                std::lock_guard<std::mutex> lock(tracker.mutex);
+                if (tracker.pending.empty()) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const double cpuMs = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        const double mb = (server.get_bytes_received() - bytesBefore) / (1024.0 * 1024.0);
+        const std::string tls = transcriber.get_tls_session(0);
+        transcriber.stop_transcription();
+
+        std::vector<int64_t> sorted;
+        {
+            std::lock_guard<std::mutex> lock(tracker.mutex);
+            sorted = tracker.latenciesNs;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        results.push_back({
+            {"profile", profile.name},
+            {"tls", tls},
+            {"chunks", sorted.size()},
+            {"dropped", dropped},
+            {"mb", mb},
+            {"cpu_ms_per_mb", mb > 0 ? cpuMs / mb : 0.0},
+            {"send_latency_us", {
+                {"p50", percentile(sorted, 0.50) / 1000.0},
+                {"p90", percentile(sorted, 0.90) / 1000.0},
+                {"p99", percentile(sorted, 0.99) / 1000.0},
+                {"max", sorted.empty() ? 0.0 : sorted.back() / 1000.0},
+            }},
+        });
+        std::cerr << profile.name << " (" << tls << "): p50 " << percentile(sorted, 0.50) / 1000 << " us, p99 "
+                  << percentile(sorted, 0.99) / 1000 << " us, " << (mb > 0 ? cpuMs / mb : 0.0) << " CPU ms/MB" << std::endl;
+    }
+
+    std::cout.rdbuf(console);
+    server.stop();
+
+    nlohmann::json report = {
+        {"schema", 1},
+        {"chunk_bytes", pcm.size()},
+        {"interval_us", interval.count()},
+        {"cpu_has_aes", cpu_has_aes()},
+        {"results", results},
+    };
+    if (outPath.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    }
+    else {
+        std::ofstream(outPath) << report.dump(2) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file TransportProfile.cpp
+ * @author zah
+ * @brief Implementation of the socket and TLS settings of TransportProfile
+ * @version 0.1
+ * @date 2024-02-23
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "TransportProfile.h"
+
+#include <openssl/ssl.h>
+
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+namespace {
+    // TLS 1.2 cipher lists (forward secret AEADs only) and TLS 1.3 cipher suites
+    const char s_aesGcm12[] = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384";
+    const char s_chacha12[] = "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+    const char s_aesGcm13[] = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384";
+    const char s_chacha13[] = "TLS_CHACHA20_POLY1305_SHA256";
+
+    /// @brief Integer TCP-level option Asio has no type for, per Asio's SettableSocketOption requirements
+    template <int Name>
+    class tcp_integer_option {
+    public:
+        explicit tcp_integer_option(int value) : m_value(value) {}
+
+        template <typename Protocol> int level(const Protocol&) const { return IPPROTO_TCP; }
+        template <typename Protocol> int name(const Protocol&) const { return Name; }
+        template <typename Protocol> const void* data(const Protocol&) const { return &m_value; }
+        template <typename Protocol> std::size_t size(const Protocol&) const { return sizeof(m_value); }
+
+    private:
+        int m_value; ///< Option value, setsockopt takes an int for all of these
+    };
+
+#if defined(TCP_KEEPIDLE)
+    typedef tcp_integer_option<TCP_KEEPIDLE> keep_alive_idle;
+#elif defined(TCP_KEEPALIVE)
+    typedef tcp_integer_option<TCP_KEEPALIVE> keep_alive_idle; // macOS
+#endif
+#if defined(TCP_KEEPINTVL)
+    typedef tcp_integer_option<TCP_KEEPINTVL> keep_alive_interval;
+#endif
+#if defined(TCP_KEEPCNT)
+    typedef tcp_integer_option<TCP_KEEPCNT> keep_alive_probes;
+#endif
+
+    template <typename Option>
+    bool set_option(boost::asio::ip::tcp::socket::lowest_layer_type& socket, const Option& option, const char* name) {
+        boost::system::error_code ec;
+        socket.set_option(option, ec);
+        if (ec) {
+            std::cerr << "Could not set " << name << ": " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+} // namespace
+
+TransportProfile TransportProfile::untuned() {
+    TransportProfile profile;
+    profile.name = "untuned";
+    profile.tcpNoDelay = false;
+    profile.keepAlive = false;
+    profile.allowTls13 = false;
+    profile.cipherPreference = CipherPreference::LIBRARY_DEFAULT;
+    return profile;
+}
+
+bool cpu_has_aes() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("aes");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) != 0;
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__aarch64__) && defined(__APPLE__)
+    return true; // Every Apple silicon core has the ARMv8 crypto extensions
+#else
+    return false;
+#endif
+}
+
+bool apply_socket_options(boost::asio::ip::tcp::socket::lowest_layer_type& socket, const TransportProfile& profile) {
+    bool ok = true;
+    if (profile.tcpNoDelay) {
+        ok &= set_option(socket, boost::asio::ip::tcp::no_delay(true), "TCP_NODELAY");
+    }
+    if (profile.sendBufferBytes > 0) {
+        ok &= set_option(socket, boost::asio::socket_base::send_buffer_size(profile.sendBufferBytes), "SO_SNDBUF");
+    }
+    if (profile.receiveBufferBytes > 0) {
+        ok &= set_option(socket, boost::asio::socket_base::receive_buffer_size(profile.receiveBufferBytes), "SO_RCVBUF");
+    }
+    if (profile.keepAlive) {
+        ok &= set_option(socket, boost::asio::socket_base::keep_alive(true), "SO_KEEPALIVE");
+#if defined(TCP_KEEPIDLE) || defined(TCP_KEEPALIVE)
+        if (profile.keepAliveIdleSeconds > 0) {
+            ok &= set_option(socket, keep_alive_idle(profile.keepAliveIdleSeconds), "TCP_KEEPIDLE");
+        }
+#endif
+#if defined(TCP_KEEPINTVL)
+        if (profile.keepAliveIntervalSeconds > 0) {
+            ok &= set_option(socket, keep_alive_interval(profile.keepAliveIntervalSeconds), "TCP_KEEPINTVL");
+        }
+#endif
+#if defined(TCP_KEEPCNT)
+        if (profile.keepAliveProbes > 0) {
+            ok &= set_option(socket, keep_alive_probes(profile.keepAliveProbes), "TCP_KEEPCNT");
+        }
+#endif
+    }
+    return ok;
+}
+
+bool apply_tls_options(boost::asio::ssl::context& ctx, const TransportProfile& profile) {
+    try {
+        ctx.set_options(
+            boost::asio::ssl::context::default_workarounds |
+            boost::asio::ssl::context::no_sslv2 |
+            boost::asio::ssl::context::no_sslv3 |
+            boost::asio::ssl::context::no_tlsv1 |
+            boost::asio::ssl::context::no_tlsv1_1 |
+            boost::asio::ssl::context::single_dh_use
+        );
+    }
+    catch (std::exception& e) {
+        std::cout << "Error in context pointer: " << e.what() << std::endl;
+        return false;
+    }
+
+    SSL_CTX* native = ctx.native_handle();
+#ifdef TLS1_3_VERSION
+    if (!profile.allowTls13) {
+        SSL_CTX_set_max_proto_version(native, TLS1_2_VERSION);
+    }
+#endif
+
+    if (profile.cipherPreference == CipherPreference::LIBRARY_DEFAULT) {
+        return true;
+    }
+    bool aesFirst = profile.cipherPreference == CipherPreference::AES_GCM
+        || (profile.cipherPreference == CipherPreference::AUTO && cpu_has_aes());
+
+    std::string list12 = aesFirst ? s_aesGcm12 : s_chacha12;
+    std::string list13 = aesFirst ? s_aesGcm13 : s_chacha13;
+    if (!profile.cipherOnly) {
+        list12 += std::string(":") + (aesFirst ? s_chacha12 : s_aesGcm12);
+        list13 += std::string(":") + (aesFirst ? s_chacha13 : s_aesGcm13);
+    }
+
+    // Client order wins unless the server enforces its own
+    if (SSL_CTX_set_cipher_list(native, list12.c_str()) != 1) {
+        std::cerr << "TLS 1.2 cipher list rejected: " << list12 << std::endl;
+        return false;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (SSL_CTX_set_ciphersuites(native, list13.c_str()) != 1) {
+        std::cerr << "TLS 1.3 cipher suites rejected: " << list13 << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,58 @@
+/**
+* @file TransportProfile.h
+* @author zah
+* @brief Header for TransportProfile: socket and TLS settings of the real-time connection
+* @version 0.1
+* @date 2024-02-23
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef TRANSPORTPROFILE_H
+#define TRANSPORTPROFILE_H
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <string>
+
+/// @brief AEAD the client offers first
+enum class CipherPreference {
+    LIBRARY_DEFAULT = 0, ///< OpenSSL's own order
+    AUTO = 1,            ///< AES-GCM if the CPU has AES instructions, ChaCha20-Poly1305 otherwise
+    AES_GCM = 2,         ///< AES-GCM first
+    CHACHA20 = 3,        ///< ChaCha20-Poly1305 first
+};
+
+/// @brief Socket and TLS settings applied to every connection of a transcriber
+struct TransportProfile {
+    std::string name{ "low_latency" }; ///< Label for logs and benchmark results
+
+    // TCP
+    bool tcpNoDelay{ true }; ///< Disable Nagle so a chunk never waits for the previous one's ACK
+    int sendBufferBytes{ 0 }; ///< SO_SNDBUF, 0 keeps the system default
+    int receiveBufferBytes{ 0 }; ///< SO_RCVBUF, 0 keeps the system default
+    bool keepAlive{ true }; ///< Detect dead connections while a session is quiet
+    int keepAliveIdleSeconds{ 30 }; ///< Idle time before the first probe, 0 keeps the system default
+    int keepAliveIntervalSeconds{ 10 }; ///< Time between probes, 0 keeps the system default
+    int keepAliveProbes{ 3 }; ///< Unanswered probes before the connection is dropped, 0 keeps the system default
+
+    // TLS
+    bool allowTls13{ true }; ///< Negotiate TLS 1.3 when OpenSSL and the server support it (TLS 1.2 is the minimum)
+    CipherPreference cipherPreference{ CipherPreference::AUTO }; ///< AEAD offered first
+    bool cipherOnly{ false }; ///< Offer only the preferred AEAD instead of keeping the others as fallback
+
+    static TransportProfile untuned(); ///< Library defaults and TLS 1.2 only, as before transport profiles
+};
+
+bool cpu_has_aes(); ///< True if the CPU has AES instructions, which make AES-GCM faster than ChaCha20
+
+/// @brief Applies the TCP options of a profile to a connected socket
+/// @return False if an option was refused (the others are still applied)
+bool apply_socket_options(boost::asio::ip::tcp::socket::lowest_layer_type& socket, const TransportProfile& profile);
+
+/// @brief Applies the protocol versions and cipher order of a profile to a TLS context
+/// @return False if OpenSSL rejected the cipher configuration
+bool apply_tls_options(boost::asio::ssl::context& ctx, const TransportProfile& profile);
+
+#endif // TRANSPORTPROFILE_H
@@ -0,0 +1,260 @@
+/**
+ * @file WireFormat.cpp
+ * @author zah
+ * @brief Implementation of allocation-free audio frame encoding and transcript message reading
+ * @version 0.1
+ * @date 2024-02-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "WireFormat.h"
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace {
+    const char s_framePrefix[] = "{\"audio_data\":\"";
+    const char s_frameSuffix[] = "\"}";
+    const char s_base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    /// @brief Position in a JSON text being scanned
+    struct Cursor {
+        const char* p;
+        const char* end;
+    };
+
+    void skip_whitespace(Cursor& c) {
+        while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\n' || *c.p == '\r')) {
+            ++c.p;
+        }
+    }
+
+    // Skips a string, cursor on the opening quote; returns the raw (still escaped) contents
+    bool skip_string(Cursor& c, std::string_view& raw) {
+        const char* start = ++c.p;
+        while (c.p < c.end && *c.p != '"') {
+            c.p += (*c.p == '\\') ? 2 : 1;
+        }
+        if (c.p >= c.end) {
+            return false;
+        }
+        raw = std::string_view(start, c.p - start);
+        ++c.p;
+        return true;
+    }
+
+    // Skips any value: strings, numbers and literals, or a whole nested object or array
+    bool skip_value(Cursor& c) {
+        std::string_view raw;
+        if (c.p >= c.end) {
+            return false;
+        }
+        if (*c.p == '"') {
+            return skip_string(c, raw);
+        }
+        if (*c.p == '{' || *c.p == '[') {
+            int depth = 0;
+            while (c.p < c.end) {
+                if (*c.p == '"') {
+                    if (!skip_string(c, raw)) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (*c.p == '{' || *c.p == '[') {
+                    ++depth;
+                }
+                else if (*c.p == '}' || *c.p == ']') {
+                    if (--depth == 0) {
+                        ++c.p;
+                        return true;
+                    }
+                }
+                ++c.p;
+            }
+            return false;
+        }
+        while (c.p < c.end && *c.p != ',' && *c.p != '}' && *c.p != ']' && *c.p != ' ' && *c.p != '\n' && *c.p != '\r' && *c.p != '\t') {
+            ++c.p;
+        }
+        return true;
+    }
+
+    int hex_value(char h) {
+        if (h >= '0' && h <= '9') return h - '0';
+        if (h >= 'a' && h <= 'f') return h - 'a' + 10;
+        if (h >= 'A' && h <= 'F') return h - 'A' + 10;
+        return -1;
+    }
+
+    bool read_hex4(const char*& p, const char* end, uint32_t& value) {
+        if (end - p < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = hex_value(p[i]);
+            if (digit < 0) {
+                return false;
+            }
+            value = (value << 4) | static_cast<uint32_t>(digit);
+        }
+        p += 4;
+        return true;
+    }
+
+    void append_utf8(uint32_t cp, std::string& out) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        }
+        else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    // Decodes the escapes of a raw JSON string into out
+    bool unescape(std::string_view raw, std::string& out) {
+        out.clear();
+        const char* p = raw.data();
+        const char* end = p + raw.size();
+        while (p < end) {
+            const char* run = p;
+            while (p < end && *p != '\\') {
+                ++p;
+            }
+            out.append(run, p - run);
+            if (p >= end) {
+                break;
+            }
+            if (++p >= end) {
+                return false;
+            }
+            char escape = *p++;
+            switch (escape) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp;
+                if (!read_hex4(p, end, cp)) {
+                    return false;
+                }
+                // Surrogate pair: a high surrogate must be followed by \u and a low surrogate
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+                        return false;
+                    }
+                    p += 2;
+                    if (!read_hex4(p, end, low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(cp, out);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+std::size_t audio_frame_size(std::size_t size) {
+    return sizeof(s_framePrefix) - 1 + 4 * ((size + 2) / 3) + sizeof(s_frameSuffix) - 1;
+}
+
+void encode_audio_frame(const char* data, std::size_t size, std::string& frame) {
+    frame.resize(audio_frame_size(size));
+    char* out = &frame[0];
+    std::memcpy(out, s_framePrefix, sizeof(s_framePrefix) - 1);
+    out += sizeof(s_framePrefix) - 1;
+
+    const auto* in = reinterpret_cast<const unsigned char*>(data);
+    std::size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t triple = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+        out[0] = s_base64[(triple >> 18) & 0x3F];
+        out[1] = s_base64[(triple >> 12) & 0x3F];
+        out[2] = s_base64[(triple >> 6) & 0x3F];
+        out[3] = s_base64[triple & 0x3F];
+        out += 4;
+    }
+    if (i < size) {
+        uint32_t triple = uint32_t(in[i]) << 16;
+        if (i + 1 < size) {
+            triple |= uint32_t(in[i + 1]) << 8;
+        }
+        out[0] = s_base64[(triple >> 18) & 0x3F];
+        out[1] = s_base64[(triple >> 12) & 0x3F];
+        out[2] = (i + 1 < size) ? s_base64[(triple >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+
+    std::memcpy(out, s_frameSuffix, sizeof(s_frameSuffix) - 1);
+}
+
+bool json_find_string(std::string_view json, std::string_view key, std::string& out) {
+    out.clear(); // Nothing of a previous message survives a failed lookup
+    Cursor c{ json.data(), json.data() + json.size() };
+    skip_whitespace(c);
+    if (c.p >= c.end || *c.p != '{') {
+        return false;
+    }
+    ++c.p;
+
+    while (true) {
+        skip_whitespace(c);
+        if (c.p >= c.end || *c.p != '"') {
+            return false; // End of the object (or malformed) without the key
+        }
+        std::string_view name;
+        if (!skip_string(c, name)) {
+            return false;
+        }
+        skip_whitespace(c);
+        if (c.p >= c.end || *c.p != ':') {
+            return false;
+        }
+        ++c.p;
+        skip_whitespace(c);
+
+        if (name == key) {
+            std::string_view raw;
+            if (c.p < c.end && *c.p == '"' && skip_string(c, raw) && unescape(raw, out)) {
+                return true;
+            }
+            out.clear(); // A bad escape leaves half a string
+            return false;
+        }
+        if (!skip_value(c)) {
+            return false;
+        }
+        skip_whitespace(c);
+        if (c.p < c.end && *c.p == ',') {
+            ++c.p;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/**
+* @file WireFormat.h
+* @author zah
+* @brief Header for encoding audio frames and reading transcript messages without allocating
+* @version 0.1
+* @date 2024-02-16
+*
+* @copyright Copyright (c) 2024
+*
+*/
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/// @brief Returns the size of the {"audio_data":"<base64>"} frame for size bytes of audio
+std::size_t audio_frame_size(std::size_t size);
+
+/// @brief Writes {"audio_data":"<base64 of data>"} into frame
+///
+/// The frame is resized, never shrunk-to-fit, so once it has been reserved with
+/// audio_frame_size() of the largest chunk it doesn't allocate again.
+void encode_audio_frame(const char* data, std::size_t size, std::string& frame);
+
+/// @brief Finds a string member of the top-level JSON object and decodes it into out
+///
+/// Other members are skipped without being materialized and out keeps its capacity,
+/// so steady-state parsing of transcript messages doesn't allocate.
+/// @return False if the member is missing, isn't a string or the JSON is malformed; out is then empty
+bool json_find_string(std::string_view json, std::string_view key, std::string& out);
+
+#endif // WIREFORMAT_H